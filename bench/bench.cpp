@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "gba.h"
+#include "arm.h"
+#include "runner.h"
+#include "sound.h"
+#ifdef GBA_TRACE
+#include "trace.h"
+#endif
+
+#ifdef GBA_THREADED
+#define BENCH_DISPATCH 2
+#else
+#define BENCH_DISPATCH 1
+#endif
+
+#define BENCH_FRAMES 2000
+#define BENCH_TRIALS 5
+
+typedef struct
+{
+    double   secs;
+    uint64_t insts;
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t hash;    // FNV-1a of the last frame
+} bench_trial_t;
+
+static const char *phase_name[PHASE_COUNT]       = {"cpu", "video", "sound", "dma"};
+static const char *dispatch_name[BENCH_DISPATCH] = {
+    "call",
+#ifdef GBA_THREADED
+    "threaded",
+#endif
+};
+
+static uint32_t screen[240 * 160];
+static int16_t  snd_ring[BUFF_SAMPLES];
+#ifdef GBA_TRACE
+static const char *trace_path = nullptr;    // Every trial rewrites the file
+#endif
+
+uint64_t frame_hash(const uint32_t *frame)
+{
+    const uint8_t *b = (const uint8_t *)frame;
+    uint64_t       h = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < 240 * 160 * 4; i++) {
+        h ^= b[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+GBA *bench_open(const char *romname, bool hle, uint8_t dispatch, uint32_t *frame, int16_t *snd)
+{
+    GBA *gba = new GBA();
+    if (!gba->init(romname, frame, snd)) {
+        delete gba;
+        return nullptr;
+    }
+    gba->phase_enb    = true;
+    gba->cpu->hle_enb = hle;
+#ifdef GBA_THREADED
+    gba->cpu->thread_enb = dispatch == 1;
+#endif
+    return gba;
+}
+bool bench_trial(const char *romname, uint32_t frames, bool hle, uint8_t dispatch, bench_trial_t *out)
+{
+    GBA *gba = bench_open(romname, hle, dispatch, screen, snd_ring);
+    if (!gba)
+        return false;
+#ifdef GBA_TRACE
+    if (trace_path && !gba->trace->trace_open(trace_path))
+        printf("Error: trace file couldn't be opened.\n");
+#endif
+
+    auto start = std::chrono::steady_clock::now();
+    // Nothing drains the sound ring, once it is full the samples are dropped
+    for (uint32_t i = 0; i < frames; i++) {
+        gba->run_frame();
+    }
+    out->secs  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    out->insts = gba->cpu->arm_insts;
+    memcpy(out->phase_ns, gba->phase_ns, sizeof(out->phase_ns));
+    out->hash = frame_hash(screen);
+
+    gba->uninit();
+    delete gba;
+    return true;
+}
+double median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+// Steps count instances through RUNNER, each one has to end on the frame a lone instance ends on
+int bench_instances(const char *romname, uint32_t frames, uint32_t trials, bool hle, uint32_t count)
+{
+    bench_trial_t single;
+    if (!bench_trial(romname, frames, hle, 0, &single))
+        return 1;
+    printf("single: %.3f s  %.1f fps  %.2f MIPS  frame hash %016llx\n", single.secs, frames / single.secs,
+           single.insts / single.secs / 1e6, (unsigned long long)single.hash);
+
+    RUNNER              runner(0);
+    std::vector<double> secs;
+    std::vector<double> fps;
+    std::vector<double> mips;
+    uint32_t            bad = 0;
+    for (uint32_t t = 0; t < trials; t++) {
+        std::vector<uint32_t> frame(count * 240 * 160);
+        std::vector<int16_t>  snd(count * BUFF_SAMPLES);
+        std::vector<GBA *>    gbas;
+        for (uint32_t i = 0; i < count; i++) {
+            GBA *gba = bench_open(romname, hle, 0, &frame[i * 240 * 160], &snd[i * BUFF_SAMPLES]);
+            if (!gba)
+                return 1;
+            gbas.push_back(gba);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        runner.run_frames(gbas.data(), count, frames);
+        double   elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t insts   = 0;
+        uint32_t match   = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t hash = frame_hash(&frame[i * 240 * 160]);
+            insts += gbas[i]->cpu->arm_insts;
+            if (hash == single.hash)
+                match++;
+            else
+                printf("instance %u: frame hash %016llx differs\n", i, (unsigned long long)hash);
+            gbas[i]->uninit();
+            delete gbas[i];
+        }
+        bad += count - match;
+        secs.push_back(elapsed);
+        fps.push_back(count * frames / elapsed);
+        mips.push_back(insts / elapsed / 1e6);
+        printf("trial %u: %.3f s  %.1f fps  %.2f MIPS  |  %u/%u instances match\n", t + 1, elapsed, fps.back(),
+               mips.back(), match, count);
+    }
+    printf("%u instances on %u threads\n", count, runner.worker_cnt);
+    printf("time  median %.3f s  min %.3f s\n", median(secs), *std::min_element(secs.begin(), secs.end()));
+    printf("fps   median %.1f  max %.1f  (all instances)\n", median(fps), *std::max_element(fps.begin(), fps.end()));
+    printf("MIPS  median %.2f  max %.2f  (all instances)\n", median(mips), *std::max_element(mips.begin(), mips.end()));
+    if (bad) {
+        printf("%u instance runs ended on a different frame\n", bad);
+        return 1;
+    }
+    return 0;
+}
+int main(int argc, char *argv[])
+{
+    const char *romname = nullptr;
+    uint32_t    frames  = BENCH_FRAMES;
+    uint32_t    trials  = BENCH_TRIALS;
+    bool        hle     = false;
+    uint32_t    count   = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            trials = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-hle"))
+            hle = true;
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            count = atoi(argv[++i]);
+#ifdef GBA_TRACE
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            trace_path = argv[++i];
+#endif
+        else
+            romname = argv[i];
+    }
+    if (!romname || !frames || !trials) {
+        printf("usage: gba_bench <rom> [-f frames] [-t trials] [-hle] [-j instances]"
+#ifdef GBA_TRACE
+               " [-trace file]"
+#endif
+               "\n");
+        return 1;
+    }
+    if (count)
+        return bench_instances(romname, frames, trials, hle, count);
+
+    // Trials alternate between the dispatch loops built in so drift on the host hits both alike
+    std::vector<double> secs[BENCH_DISPATCH];
+    std::vector<double> fps[BENCH_DISPATCH];
+    std::vector<double> mips[BENCH_DISPATCH];
+    uint64_t            hash[BENCH_DISPATCH];
+    for (uint32_t t = 0; t < trials; t++) {
+        for (uint8_t d = 0; d < BENCH_DISPATCH; d++) {
+            bench_trial_t trial;
+            if (!bench_trial(romname, frames, hle, d, &trial))
+                return 1;
+            secs[d].push_back(trial.secs);
+            fps[d].push_back(frames / trial.secs);
+            mips[d].push_back(trial.insts / trial.secs / 1e6);
+            hash[d] = trial.hash;
+
+            uint64_t total = trial.secs * 1e9;
+            uint64_t other = total;
+            printf("trial %u %s: %.3f s  %.1f fps  %.2f MIPS  |", t + 1, dispatch_name[d], trial.secs, fps[d].back(),
+                   mips[d].back());
+            for (uint8_t p = 0; p < PHASE_COUNT; p++) {
+                printf("  %s %.1f%%", phase_name[p], 100.0 * trial.phase_ns[p] / total);
+                other -= std::min(other, trial.phase_ns[p]);
+            }
+            printf("  other %.1f%%\n", 100.0 * other / total);
+        }
+    }
+    for (uint8_t d = 0; d < BENCH_DISPATCH; d++) {
+        printf("dispatch %s  frame hash %016llx\n", dispatch_name[d], (unsigned long long)hash[d]);
+        printf("time  median %.3f s  min %.3f s\n", median(secs[d]), *std::min_element(secs[d].begin(), secs[d].end()));
+        printf("fps   median %.1f  max %.1f\n", median(fps[d]), *std::max_element(fps[d].begin(), fps[d].end()));
+        printf("MIPS  median %.2f  max %.2f\n", median(mips[d]), *std::max_element(mips[d].begin(), mips[d].end()));
+    }
+    return 0;
+}
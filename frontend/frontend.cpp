@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include "frontend.h"
+#include "io.h"
+#ifdef GBA_TRACE
+#include "trace.h"
+#endif
+
+
+FRONTEND::FRONTEND(GBA *_gba)
+{
+    gba = _gba;
+}
+void sound_cb(void *data, uint8_t *stream, int32_t len)
+{
+    ((GBA *)data)->sound->sound_mix(data, stream, len);
+}
+void FRONTEND::sdl_init()
+{
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    window             = SDL_CreateWindow("", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 480, 320, 0);
+    renderer           = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    texture            = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGRA8888, SDL_TEXTUREACCESS_STREAMING, 240, 160);
+    SDL_AudioSpec spec = {.freq     = SND_FREQUENCY,    // 32KHz
+                          .format   = AUDIO_S16SYS,     // Signed 16 bits System endiannes
+                          .channels = SND_CHANNELS,     // Stereo
+                          .samples  = SND_SAMPLES,      // 16ms
+                          .callback = sound_cb,
+                          .userdata = gba};
+    SDL_OpenAudio(&spec, NULL);
+    SDL_PauseAudio(0);
+}
+void FRONTEND::sdl_uninit()
+{
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_CloseAudio();
+    SDL_Quit();
+}
+void FRONTEND::key_event(SDL_Keycode key, bool down)
+{
+    uint16_t btn;
+    switch (key) {
+        case SDLK_BACKSPACE:
+            rewinding = down;
+            return;
+#ifdef GBA_TRACE
+        case SDLK_F12:
+            if (down)
+                gba->trace->trace_dump(stdout, TRACE_DUMP_CNT);
+            return;
+#endif
+        case SDLK_UP:
+            btn = BTN_U;
+            break;
+        case SDLK_DOWN:
+            btn = BTN_D;
+            break;
+        case SDLK_LEFT:
+            btn = BTN_L;
+            break;
+        case SDLK_RIGHT:
+            btn = BTN_R;
+            break;
+        case SDLK_a:
+            btn = BTN_A;
+            break;
+        case SDLK_s:
+            btn = BTN_B;
+            break;
+        case SDLK_q:
+            btn = BTN_LT;
+            break;
+        case SDLK_w:
+            btn = BTN_RT;
+            break;
+        case SDLK_TAB:
+            btn = BTN_SEL;
+            break;
+        case SDLK_RETURN:
+            btn = BTN_STA;
+            break;
+        default:
+            return;
+    }
+    if (down)
+        gba->io->key_input.w &= ~btn;
+    else
+        gba->io->key_input.w |= btn;
+}
+void FRONTEND::start()
+{
+    bool run = true;
+    while (run) {
+        // Step back two states and replay one so the rewound frame gets drawn
+        if (!rewinding || rewind->rewind_pop(gba, 2)) {
+            gba->run_frame();
+            rewind->rewind_push(gba);
+        }
+
+        SDL_UpdateTexture(texture, NULL, screen, SCREEN_W * 4);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            switch (event.type) {
+                case SDL_KEYDOWN:
+                    key_event(event.key.keysym.sym, true);
+                    break;
+                case SDL_KEYUP:
+                    key_event(event.key.keysym.sym, false);
+                    break;
+                case SDL_QUIT:
+                    run = false;
+                    break;
+            }
+        }
+    }
+}
+int FRONTEND::run(const char *romname)
+{
+    if (!gba->init(romname, screen, snd_ring))
+        return 0;
+
+    rewind = new REWIND(gba->state_size(), REWIND_RING_SZ);
+    sdl_init();
+    start();
+    sdl_uninit();
+    printf("Audio: %u underruns, %u overruns\n", gba->sound->snd_underruns.load(), gba->sound->snd_overruns.load());
+    delete rewind;
+    gba->uninit();
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _FRONTEND_H_
+#define _FRONTEND_H_
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_render.h>
+#include "gba.h"
+#include "rewind.h"
+#include "sound.h"
+
+#define SCREEN_W 240
+#define SCREEN_H 160
+
+
+class FRONTEND {
+  public:
+    GBA    *gba       = nullptr;
+    REWIND *rewind    = nullptr;
+    bool    rewinding = false;    // Backspace held
+
+    SDL_Window   *window;
+    SDL_Renderer *renderer;
+    SDL_Texture  *texture;
+
+    uint32_t screen[SCREEN_W * SCREEN_H];
+    int16_t  snd_ring[BUFF_SAMPLES];
+
+  public:
+    FRONTEND(GBA *_gba);
+
+    void sdl_init();
+    void sdl_uninit();
+    void key_event(SDL_Keycode key, bool down);
+    void start();
+    int  run(const char *romname);
+};
+
+#endif
@@ -0,0 +1,9 @@
+#include "frontend.h"
+
+
+int main(int argc, char *argv[])
+{
+    GBA      *gba      = new GBA();
+    FRONTEND *frontend = new FRONTEND(gba);
+    frontend->run(argv[1]);
+}
@@ -1,9 +1,22 @@
 #include <cstdint>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef GBA_PROFILE
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#endif
 #include "arm.h"
+#include "hle.h"
 #include "mem.h"
 #include "io.h"
 #include "timer.h"
+#ifdef GBA_TRACE
+#include "scheduler.h"
+#include "trace.h"
+#endif
 
 #define ARM_ARITH_SUB     0
 #define ARM_ARITH_ADD     1
@@ -26,51 +39,96 @@
 
 #define CALL_MEMBER_FN(object, ptrToMember) ((object).*(ptrToMember))
 
+// Runs of template handler instances, v is the first variant and d picks the block cache decoded fields.
+// m turns one instance into a table entry: the handler itself or its ARM or Thumb block trampoline
+#define SPEC_PROC(fn, v, d)       &CPU::fn<v, d>
+#define SPEC_ARM_THREAD(fn, v, d) &CPU::arm_thread_op<&CPU::fn<v, d>, false>
+#define SPEC_T16_THREAD(fn, v, d) &CPU::arm_thread_op<&CPU::fn<v, d>, true>
+
+#define SPEC_4(m, fn, v, d)   m(fn, (v), d), m(fn, (v) + 1, d), m(fn, (v) + 2, d), m(fn, (v) + 3, d)
+#define SPEC_8(m, fn, v, d)   SPEC_4(m, fn, v, d), SPEC_4(m, fn, (v) + 4, d)
+#define SPEC_16(m, fn, v, d)  SPEC_8(m, fn, v, d), SPEC_8(m, fn, (v) + 8, d)
+#define SPEC_32(m, fn, v, d)  SPEC_16(m, fn, v, d), SPEC_16(m, fn, (v) + 16, d)
+#define SPEC_64(m, fn, v, d)  SPEC_32(m, fn, v, d), SPEC_32(m, fn, (v) + 32, d)
+#define SPEC_128(m, fn, v, d) SPEC_64(m, fn, v, d), SPEC_64(m, fn, (v) + 64, d)
+
+// Bit n of each entry says whether the condition passes with NZCV == n
+static const uint16_t arm_cond_lut[16] = {
+    0xf0f0,    // EQ
+    0x0f0f,    // NE
+    0xcccc,    // CS
+    0x3333,    // CC
+    0xff00,    // MI
+    0x00ff,    // PL
+    0xaaaa,    // VS
+    0x5555,    // VC
+    0x0c0c,    // HI
+    0xf3f3,    // LS
+    0xaa55,    // GE
+    0x55aa,    // LT
+    0x0a05,    // GT
+    0xf5fa,    // LE
+    0xffff,    // AL
+    0x0000,    // NV, decoded as unconditional before it gets here
+};
+
+// Bank of each mode by its low 4 bits, modes the core does not know fall back to User
+static const uint8_t arm_bank_lut[16] = {
+    BANK_USR, BANK_FIQ, BANK_IRQ, BANK_SVC, BANK_USR, BANK_USR, BANK_MON, BANK_ABT,
+    BANK_USR, BANK_USR, BANK_USR, BANK_UND, BANK_USR, BANK_USR, BANK_USR, BANK_USR,
+};
 
 CPU::CPU(GBA *_gba)
 {
     gba = _gba;
 }
-bool CPU::arm_flag_tst(uint32_t flag)
-{
-    return arm_r.cpsr & flag;
-}
-bool CPU::arm_cond(int8_t cond)
+void CPU::arm_flags_sync()
 {
-    bool res;
-    bool n = arm_flag_tst(ARM_N);
-    bool z = arm_flag_tst(ARM_Z);
-    bool c = arm_flag_tst(ARM_C);
-    bool v = arm_flag_tst(ARM_V);
-    switch (cond >> 1) {
-        case 0:
-            res = z;
-            break;
-        case 1:
-            res = c;
-            break;
-        case 2:
-            res = n;
+    uint32_t res = flag_res;
+    uint32_t nzcv;
+    switch (flag_op) {
+        case FLAGS_ADD:
+            nzcv = flag_res > 0xffffffff ? ARM_C : 0;
+            nzcv |= (~(flag_lhs ^ flag_rhs) & (flag_lhs ^ res) & 0x80000000) >> 3;
             break;
-        case 3:
-            res = v;
+        case FLAGS_SUB:
+            nzcv = flag_res < 0x100000000ULL ? ARM_C : 0;
+            nzcv |= ((flag_lhs ^ flag_rhs) & (flag_lhs ^ res) & 0x80000000) >> 3;
             break;
-        case 4:
-            res = c && !z;
-            break;
-        case 5:
-            res = n == v;
-            break;
-        case 6:
-            res = !z && n == v;
+        case FLAGS_LOGIC:
+            nzcv = (flag_lhs ? ARM_C : 0) | (arm_r.cpsr & ARM_V);
             break;
         default:
-            res = true;
-            break;
+            return;
     }
-    if (cond & 1)
-        res = !res;
-    return res;
+    nzcv |= res & ARM_N;
+    nzcv |= res ? 0 : ARM_Z;
+    arm_r.cpsr = (arm_r.cpsr & ~ARM_NZCV) | nzcv;
+    flag_op    = FLAGS_SYNCED;
+}
+bool CPU::arm_carry()
+{
+    // Shifter operands read C on every instruction, don't sync the other flags for it
+    switch (flag_op) {
+        case FLAGS_ADD:
+            return flag_res > 0xffffffff;
+        case FLAGS_SUB:
+            return flag_res < 0x100000000ULL;
+        case FLAGS_LOGIC:
+            return flag_lhs;
+    }
+    return arm_r.cpsr & ARM_C;
+}
+bool CPU::arm_flag_tst(uint32_t flag)
+{
+    if (flag & ARM_NZCV)
+        arm_flags_sync();
+    return arm_r.cpsr & flag;
+}
+bool CPU::arm_cond(int8_t cond)
+{
+    arm_flags_sync();
+    return (arm_cond_lut[cond] >> (arm_r.cpsr >> 28)) & 1;
 }
 bool CPU::arm_in_thumb()
 {
@@ -93,97 +151,92 @@ uint32_t CPU::arm_ssatq(int64_t val)
 {
     return arm_saturate(val, 0x80000000, 0x7fffffff, true);
 }
-uint16_t CPU::arm_fetchh(access_type_e at)
+void CPU::arm_fetch_map()
 {
-    switch (arm_r.r[15] >> 24) {
+    uint8_t n_arm = 1, s_arm = 1, n_t16 = 1, s_t16 = 1;
+    uint8_t ws;
+    fetch_region = arm_r.r[15] >> 24;
+    switch (fetch_region) {
         case 0x0:
-            arm_cycles += 1;
-            return (gba->mem->bios_op = *(uint16_t *)(gba->bios + (arm_r.r[15] & 0x3fff)));
+            fetch_base = gba->bios;
+            fetch_mask = 0x3fff;
+            break;
         case 0x2:
-            arm_cycles += 3;
-            return *(uint16_t *)(gba->mem->wram + (arm_r.r[15] & 0x3ffff));
+            fetch_base = gba->mem->wram;
+            fetch_mask = 0x3ffff;
+            n_arm = s_arm = 6;
+            n_t16 = s_t16 = 3;
+            break;
         case 0x3:
-            arm_cycles += 1;
-            return *(uint16_t *)(gba->mem->iwram + (arm_r.r[15] & 0x7fff));
+            fetch_base = gba->mem->iwram;
+            fetch_mask = 0x7fff;
+            break;
         case 0x5:
-            arm_cycles += 1;
-            return *(uint16_t *)(gba->mem->pram + (arm_r.r[15] & 0x3ff));
+            fetch_base = gba->mem->pram;
+            fetch_mask = 0x3ff;
+            break;
         case 0x7:
-            arm_cycles += 1;
-            return *(uint16_t *)(gba->mem->oam + (arm_r.r[15] & 0x3ff));
+            fetch_base = gba->mem->oam;
+            fetch_mask = 0x3ff;
+            break;
         case 0x8:
         case 0x9:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_t16[0];
-            else
-                arm_cycles += gba->io->ws_s_t16[0];
-            return *(uint16_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
         case 0xa:
         case 0xb:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_t16[1];
-            else
-                arm_cycles += gba->io->ws_s_t16[1];
-            return *(uint16_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
         case 0xc:
         case 0xd:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_t16[2];
-            else
-                arm_cycles += gba->io->ws_s_t16[2];
-            return *(uint16_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
+            ws         = (fetch_region - 0x8) >> 1;
+            fetch_base = gba->rom;
+            fetch_mask = 0x1ffffff;
+            n_arm      = gba->io->ws_n_arm[ws];
+            s_arm      = gba->io->ws_s_arm[ws];
+            n_t16      = gba->io->ws_n_t16[ws];
+            s_t16      = gba->io->ws_s_t16[ws];
+            break;
         default:
-            if (at == NON_SEQ)
-                return gba->mem->arm_readh_n(arm_r.r[15]);
-            else
-                return gba->mem->arm_readh_s(arm_r.r[15]);
+            fetch_base = nullptr;
+            break;
+    }
+    fetch_n_arm = n_arm;
+    fetch_s_arm = s_arm;
+    fetch_n_t16 = n_t16;
+    fetch_s_t16 = s_t16;
+}
+void CPU::arm_fetch_clear()
+{
+    fetch_region = FETCH_NONE;
+}
+uint16_t CPU::arm_fetchh(access_type_e at)
+{
+    if ((arm_r.r[15] >> 24) != fetch_region)
+        arm_fetch_map();
+    if (!fetch_base) {
+        if (at == NON_SEQ)
+            return gba->mem->arm_readh_n(arm_r.r[15]);
+        else
+            return gba->mem->arm_readh_s(arm_r.r[15]);
     }
+    arm_cycles += at == NON_SEQ ? fetch_n_t16 : fetch_s_t16;
+    uint16_t op = *(uint16_t *)(fetch_base + (arm_r.r[15] & fetch_mask));
+    if (fetch_region == 0)
+        gba->mem->bios_op = op;
+    return op;
 }
 uint32_t CPU::arm_fetch(access_type_e at)
 {
-    switch (arm_r.r[15] >> 24) {
-        case 0x0:
-            arm_cycles += 1;
-            return (gba->mem->bios_op = *(uint32_t *)(gba->bios + (arm_r.r[15] & 0x3fff)));
-        case 0x2:
-            arm_cycles += 6;
-            return *(uint32_t *)(gba->mem->wram + (arm_r.r[15] & 0x3ffff));
-        case 0x3:
-            arm_cycles += 1;
-            return *(uint32_t *)(gba->mem->iwram + (arm_r.r[15] & 0x7fff));
-        case 0x5:
-            arm_cycles += 1;
-            return *(uint32_t *)(gba->mem->pram + (arm_r.r[15] & 0x3ff));
-        case 0x7:
-            arm_cycles += 1;
-            return *(uint32_t *)(gba->mem->oam + (arm_r.r[15] & 0x3ff));
-        case 0x8:
-        case 0x9:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_arm[0];
-            else
-                arm_cycles += gba->io->ws_s_arm[0];
-            return *(uint32_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
-        case 0xa:
-        case 0xb:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_arm[1];
-            else
-                arm_cycles += gba->io->ws_s_arm[1];
-            return *(uint32_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
-        case 0xc:
-        case 0xd:
-            if (at == NON_SEQ)
-                arm_cycles += gba->io->ws_n_arm[2];
-            else
-                arm_cycles += gba->io->ws_s_arm[2];
-            return *(uint32_t *)(gba->rom + (arm_r.r[15] & 0x1ffffff));
-        default:
-            if (at == NON_SEQ)
-                return gba->mem->arm_read_n(arm_r.r[15]);
-            else
-                return gba->mem->arm_read_s(arm_r.r[15]);
+    if ((arm_r.r[15] >> 24) != fetch_region)
+        arm_fetch_map();
+    if (!fetch_base) {
+        if (at == NON_SEQ)
+            return gba->mem->arm_read_n(arm_r.r[15]);
+        else
+            return gba->mem->arm_read_s(arm_r.r[15]);
     }
+    arm_cycles += at == NON_SEQ ? fetch_n_arm : fetch_s_arm;
+    uint32_t op = *(uint32_t *)(fetch_base + (arm_r.r[15] & fetch_mask));
+    if (fetch_region == 0)
+        gba->mem->bios_op = op;
+    return op;
 }
 uint32_t CPU::arm_fetch_n()
 {
@@ -216,6 +269,13 @@ uint32_t CPU::arm_memio_reg_get(uint8_t reg)
     else
         return arm_r.r[reg];
 }
+uint8_t CPU::arm_memio_reg_cnt(uint16_t regs)
+{
+    uint8_t cnt = 0;
+    for (; regs; regs &= regs - 1)
+        cnt++;
+    return cnt;
+}
 arm_data_t CPU::arm_data_imm_op()
 {
     uint32_t imm   = (arm_op >> 0) & 0xff;
@@ -231,7 +291,7 @@ arm_shifter_t CPU::arm_data_regi(uint8_t rm, uint8_t type, uint8_t imm)
 {
     arm_shifter_t out;
     out.val    = arm_r.r[rm];
-    out.cout   = arm_flag_tst(ARM_C);
+    out.cout   = arm_carry();
     uint32_t m = out.val;
     uint8_t  c = out.cout;
     switch (type) {
@@ -278,7 +338,7 @@ arm_shifter_t CPU::arm_data_regr(uint8_t rm, uint8_t type, uint8_t rs)
 {
     arm_shifter_t out;
     out.val  = arm_r.r[rm];
-    out.cout = arm_flag_tst(ARM_C);
+    out.cout = arm_carry();
     if (rm == 15)
         out.val += 4;
     uint8_t sh = arm_r.r[rs];
@@ -416,13 +476,6 @@ arm_mpy_t CPU::arm_mpy_op()
     arm_mpy_t op = {.lhs = arm_r.r[rn], .rhs = arm_r.r[rm], .ra = ra, .rd = rd, .s = s};
     return op;
 }
-arm_mpy_t CPU::t16_mpy_op()
-{
-    uint8_t   rdn = (arm_op >> 0) & 7;
-    uint8_t   rm  = (arm_op >> 3) & 7;
-    arm_mpy_t op  = {.lhs = arm_r.r[rdn], .rhs = arm_r.r[rm], .rd = rdn, .s = true};
-    return op;
-}
 arm_psr_t CPU::arm_mrs_op()
 {
     arm_psr_t op = {.rd = static_cast<uint8_t>((arm_op >> 12) & 0xf), .r = static_cast<bool>((arm_op >> 22) & 0x1)};
@@ -518,6 +571,131 @@ arm_memio_t CPU::arm_memio_reg_op()
         arm_r.r[rn] += disp;
     return op;
 }
+// With d set the fields come from the block cache entry, the immediate already rotated
+template <bool s, bool d>
+arm_data_t CPU::arm_data_imm_op()
+{
+    uint32_t imm;
+    uint8_t  rd, rn;
+    if constexpr (d) {
+        imm = arm_dec->imm;
+        rd  = arm_dec->rd;
+        rn  = arm_dec->rn;
+    } else {
+        imm = ROR((arm_op >> 0) & 0xff, (arm_op >> 7) & 0x1e);
+        rd  = (arm_op >> 12) & 0xf;
+        rn  = (arm_op >> 16) & 0xf;
+    }
+    arm_data_t op = {.lhs = arm_r.r[rn], .rhs = imm, .rd = rd, .cout = static_cast<bool>(imm & (1 << 31)), .s = s};
+    return op;
+}
+// Carry out is only worked out when c is set, RRX still reads the carry in
+template <uint8_t type, bool c>
+arm_shifter_t CPU::arm_data_regi(uint8_t rm, uint8_t imm)
+{
+    arm_shifter_t out;
+    uint32_t      m = arm_r.r[rm];
+    out.val         = m;
+    out.cout        = false;
+    if constexpr (type == 0) {    // LSL
+        if (imm) {
+            out.val = m << imm;
+            if constexpr (c)
+                out.cout = m & (1 << (32 - imm));
+        } else if constexpr (c) {
+            out.cout = arm_carry();
+        }
+    } else if constexpr (type == 3) {    // ROR
+        if (imm) {
+            out.val = ROR(m, imm);
+            if constexpr (c)
+                out.cout = m & (1 << (imm - 1));
+        } else {    // RRX
+            out.val = ROR((m & ~1) | arm_carry(), 1);
+            if constexpr (c)
+                out.cout = m & 1;
+        }
+    } else {    // LSR, ASR
+        if (imm == 0)
+            imm = 32;
+        if constexpr (type == 2)
+            out.val = (int64_t)((int32_t)m) >> imm;
+        else
+            out.val = (uint64_t)m >> imm;
+        if constexpr (c)
+            out.cout = m & (1 << (imm - 1));
+    }
+    return out;
+}
+template <bool s, uint8_t type, bool d>
+arm_data_t CPU::arm_data_regi_op()
+{
+    uint8_t rm, imm, rd, rn;
+    if constexpr (d) {
+        rm  = arm_dec->rm;
+        imm = arm_dec->imm;
+        rd  = arm_dec->rd;
+        rn  = arm_dec->rn;
+    } else {
+        rm  = (arm_op >> 0) & 0xf;
+        imm = (arm_op >> 7) & 0x1f;
+        rd  = (arm_op >> 12) & 0xf;
+        rn  = (arm_op >> 16) & 0xf;
+    }
+    arm_shifter_t shift = arm_data_regi<type, s>(rm, imm);
+    arm_data_t    op    = {.lhs = arm_r.r[rn], .rhs = shift.val, .rd = rd, .cout = shift.cout, .s = s};
+    return op;
+}
+template <bool p, bool u, bool w, bool d>
+arm_memio_t CPU::arm_memio_imm_op()
+{
+    uint16_t imm;
+    uint8_t  rt, rn;
+    if constexpr (d) {
+        imm = arm_dec->imm;
+        rt  = arm_dec->rd;
+        rn  = arm_dec->rn;
+    } else {
+        imm = (arm_op >> 0) & 0xfff;
+        rt  = (arm_op >> 12) & 0xf;
+        rn  = (arm_op >> 16) & 0xf;
+    }
+    arm_memio_t op = {.rt = rt, .addr = arm_r.r[rn]};
+    if (rn == 15)
+        op.addr &= ~3;
+    int32_t disp = u ? imm : -imm;
+    if constexpr (p)
+        op.addr += disp;
+    if constexpr (!p || w)
+        arm_r.r[rn] += disp;
+    return op;
+}
+template <bool p, bool u, bool w, uint8_t type, bool d>
+arm_memio_t CPU::arm_memio_reg_op()
+{
+    uint8_t rm, imm, rt, rn;
+    if constexpr (d) {
+        rm  = arm_dec->rm;
+        imm = arm_dec->imm;
+        rt  = arm_dec->rd;
+        rn  = arm_dec->rn;
+    } else {
+        rm  = (arm_op >> 0) & 0xf;
+        imm = (arm_op >> 7) & 0x1f;
+        rt  = (arm_op >> 12) & 0xf;
+        rn  = (arm_op >> 16) & 0xf;
+    }
+    arm_memio_t op = {.rt = rt, .addr = arm_r.r[rn]};
+    if (rn == 15)
+        op.addr &= ~3;
+    arm_shifter_t shift = arm_data_regi<type, false>(rm, imm);
+    int32_t       disp  = u ? shift.val : -shift.val;
+    if constexpr (p)
+        op.addr += disp;
+    if constexpr (!p || w)
+        arm_r.r[rn] += disp;
+    return op;
+}
 arm_memio_t CPU::arm_memio_immt_op()
 {
     uint32_t    imm = (arm_op >> 0) & 0xfff;
@@ -651,101 +829,26 @@ arm_parith_t CPU::arm_parith_op()
 }
 void CPU::arm_flag_set(uint32_t flag, bool cond)
 {
+    if (flag & ARM_NZCV)
+        arm_flags_sync();
+    if (flag & ARM_T)
+        t_exit = true;
     if (cond)
         arm_r.cpsr |= flag;
     else
         arm_r.cpsr &= ~flag;
 }
-void CPU::arm_bank_to_regs(int8_t mode)
-{
-    if (mode != ARM_FIQ) {
-        arm_r.r[8]  = arm_r.r8_usr;
-        arm_r.r[9]  = arm_r.r9_usr;
-        arm_r.r[10] = arm_r.r10_usr;
-        arm_r.r[11] = arm_r.r11_usr;
-        arm_r.r[12] = arm_r.r12_usr;
-    }
-    switch (mode) {
-        case ARM_USR:
-        case ARM_SYS:
-            arm_r.r[13] = arm_r.r13_usr;
-            arm_r.r[14] = arm_r.r14_usr;
-            break;
-        case ARM_FIQ:
-            arm_r.r[8]  = arm_r.r8_fiq;
-            arm_r.r[9]  = arm_r.r9_fiq;
-            arm_r.r[10] = arm_r.r10_fiq;
-            arm_r.r[11] = arm_r.r11_fiq;
-            arm_r.r[12] = arm_r.r12_fiq;
-            arm_r.r[13] = arm_r.r13_fiq;
-            arm_r.r[14] = arm_r.r14_fiq;
-            break;
-        case ARM_IRQ:
-            arm_r.r[13] = arm_r.r13_irq;
-            arm_r.r[14] = arm_r.r14_irq;
-            break;
-        case ARM_SVC:
-            arm_r.r[13] = arm_r.r13_svc;
-            arm_r.r[14] = arm_r.r14_svc;
-            break;
-        case ARM_MON:
-            arm_r.r[13] = arm_r.r13_mon;
-            arm_r.r[14] = arm_r.r14_mon;
-            break;
-        case ARM_ABT:
-            arm_r.r[13] = arm_r.r13_abt;
-            arm_r.r[14] = arm_r.r14_abt;
-            break;
-        case ARM_UND:
-            arm_r.r[13] = arm_r.r13_und;
-            arm_r.r[14] = arm_r.r14_und;
-            break;
-    }
-}
-void CPU::arm_regs_to_bank(int8_t mode)
+void CPU::arm_bank_swap(int8_t curr, int8_t mode)
 {
-    if (mode != ARM_FIQ) {
-        arm_r.r8_usr  = arm_r.r[8];
-        arm_r.r9_usr  = arm_r.r[9];
-        arm_r.r10_usr = arm_r.r[10];
-        arm_r.r11_usr = arm_r.r[11];
-        arm_r.r12_usr = arm_r.r[12];
-    }
-    switch (mode) {
-        case ARM_USR:
-        case ARM_SYS:
-            arm_r.r13_usr = arm_r.r[13];
-            arm_r.r14_usr = arm_r.r[14];
-            break;
-        case ARM_FIQ:
-            arm_r.r8_fiq  = arm_r.r[8];
-            arm_r.r9_fiq  = arm_r.r[9];
-            arm_r.r10_fiq = arm_r.r[10];
-            arm_r.r11_fiq = arm_r.r[11];
-            arm_r.r12_fiq = arm_r.r[12];
-            arm_r.r13_fiq = arm_r.r[13];
-            arm_r.r14_fiq = arm_r.r[14];
-            break;
-        case ARM_IRQ:
-            arm_r.r13_irq = arm_r.r[13];
-            arm_r.r14_irq = arm_r.r[14];
-            break;
-        case ARM_SVC:
-            arm_r.r13_svc = arm_r.r[13];
-            arm_r.r14_svc = arm_r.r[14];
-            break;
-        case ARM_MON:
-            arm_r.r13_mon = arm_r.r[13];
-            arm_r.r14_mon = arm_r.r[14];
-            break;
-        case ARM_ABT:
-            arm_r.r13_abt = arm_r.r[13];
-            arm_r.r14_abt = arm_r.r[14];
-            break;
-        case ARM_UND:
-            arm_r.r13_und = arm_r.r[13];
-            arm_r.r14_und = arm_r.r[14];
-            break;
+    uint8_t from = arm_bank_lut[curr & 0xf];
+    uint8_t to   = arm_bank_lut[mode & 0xf];
+    if (from == to)
+        return;
+    memcpy(arm_r.r13_bank[from], &arm_r.r[13], 8);
+    memcpy(&arm_r.r[13], arm_r.r13_bank[to], 8);
+    if (from == BANK_FIQ || to == BANK_FIQ) {
+        memcpy(from == BANK_FIQ ? arm_r.r8_fiq : arm_r.r8_usr, &arm_r.r[8], 20);
+        memcpy(&arm_r.r[8], to == BANK_FIQ ? arm_r.r8_fiq : arm_r.r8_usr, 20);
     }
 }
 void CPU::arm_mode_set(int8_t mode)
@@ -753,62 +856,28 @@ void CPU::arm_mode_set(int8_t mode)
     int8_t curr = arm_r.cpsr & 0x1f;
     arm_r.cpsr &= ~0x1f;
     arm_r.cpsr |= mode;
-    arm_regs_to_bank(curr);
-    arm_bank_to_regs(mode);
+    arm_bank_swap(curr, mode);
 }
 void CPU::arm_spsr_get(uint32_t *psr)
 {
-    switch (arm_r.cpsr & 0x1f) {
-        case ARM_FIQ:
-            *psr = arm_r.spsr_fiq;
-            break;
-        case ARM_IRQ:
-            *psr = arm_r.spsr_irq;
-            break;
-        case ARM_SVC:
-            *psr = arm_r.spsr_svc;
-            break;
-        case ARM_MON:
-            *psr = arm_r.spsr_mon;
-            break;
-        case ARM_ABT:
-            *psr = arm_r.spsr_abt;
-            break;
-        case ARM_UND:
-            *psr = arm_r.spsr_und;
-            break;
-    }
+    // User and System have no SPSR, the destination is left alone
+    uint8_t bank = arm_bank_lut[arm_r.cpsr & 0xf];
+    if (bank != BANK_USR)
+        *psr = arm_r.spsr[bank];
 }
 void CPU::arm_spsr_set(uint32_t spsr)
 {
-    switch (arm_r.cpsr & 0x1f) {
-        case ARM_FIQ:
-            arm_r.spsr_fiq = spsr;
-            break;
-        case ARM_IRQ:
-            arm_r.spsr_irq = spsr;
-            break;
-        case ARM_SVC:
-            arm_r.spsr_svc = spsr;
-            break;
-        case ARM_MON:
-            arm_r.spsr_mon = spsr;
-            break;
-        case ARM_ABT:
-            arm_r.spsr_abt = spsr;
-            break;
-        case ARM_UND:
-            arm_r.spsr_und = spsr;
-            break;
-    }
+    uint8_t bank = arm_bank_lut[arm_r.cpsr & 0xf];
+    if (bank != BANK_USR)
+        arm_r.spsr[bank] = spsr;
 }
 void CPU::arm_spsr_to_cpsr()
 {
+    arm_flags_sync();
+    t_exit = true;
     int8_t curr = arm_r.cpsr & 0x1f;
     arm_spsr_get(&arm_r.cpsr);
-    int8_t mode = arm_r.cpsr & 0x1f;
-    arm_regs_to_bank(curr);
-    arm_bank_to_regs(mode);
+    arm_bank_swap(curr, arm_r.cpsr & 0x1f);
 }
 void CPU::arm_setn(uint32_t res)
 {
@@ -887,22 +956,17 @@ void CPU::arm_arith_set(arm_data_t op, uint64_t res, bool add)
             arm_load_pipe();
         }
     } else if (op.s) {
-        arm_setn(res);
-        arm_setz(res);
-        if (add) {
-            arm_addc(res);
-            arm_addv(op.lhs, op.rhs, res);
-        } else {
-            arm_subc(res);
-            arm_subv(op.lhs, op.rhs, res);
-        }
+        flag_op  = add ? FLAGS_ADD : FLAGS_SUB;
+        flag_lhs = op.lhs;
+        flag_rhs = op.rhs;
+        flag_res = res;
     }
 }
 void CPU::arm_arith_add(arm_data_t op, bool adc)
 {
     uint64_t res = op.lhs + op.rhs;
     if (adc)
-        res += arm_flag_tst(ARM_C);
+        res += arm_carry();
     arm_r.r[op.rd] = res;
     arm_arith_set(op, res, ARM_ARITH_ADD);
 }
@@ -915,7 +979,7 @@ void CPU::arm_arith_subtract(arm_data_t op, bool sbc, bool rev)
     }
     uint64_t res = op.lhs - op.rhs;
     if (sbc)
-        res -= !arm_flag_tst(ARM_C);
+        res -= !arm_carry();
     arm_r.r[op.rd] = res;
     arm_arith_set(op, res, ARM_ARITH_SUB);
 }
@@ -956,9 +1020,12 @@ void CPU::arm_logic_set(arm_data_t op, uint32_t res)
             arm_load_pipe();
         }
     } else if (op.s) {
-        arm_setn(res);
-        arm_setz(res);
-        arm_flag_set(ARM_C, op.cout);
+        // V is kept, so an add or subtract still pending has to land first
+        if (flag_op != FLAGS_LOGIC)
+            arm_flags_sync();
+        flag_op  = FLAGS_LOGIC;
+        flag_lhs = op.cout;
+        flag_res = res;
     }
 }
 void CPU::arm_logic(arm_data_t op, arm_logic_e inst)
@@ -1005,7 +1072,7 @@ void CPU::arm_lsl(arm_data_t op)
 {
     uint64_t val = op.lhs;
     uint8_t  sh  = op.rhs;
-    bool     c   = arm_flag_tst(ARM_C);
+    bool     c   = arm_carry();
     op.rhs       = val;
     op.cout      = c;
     if (sh > 32) {
@@ -1022,7 +1089,7 @@ void CPU::arm_lsr(arm_data_t op)
 {
     uint64_t val = op.lhs;
     uint8_t  sh  = op.rhs;
-    bool     c   = arm_flag_tst(ARM_C);
+    bool     c   = arm_carry();
     op.rhs       = val;
     op.cout      = c;
     if (sh > 32) {
@@ -1039,7 +1106,7 @@ void CPU::arm_ror(arm_data_t op)
 {
     uint64_t val = op.lhs;
     uint8_t  sh  = op.rhs;
-    bool     c   = arm_flag_tst(ARM_C);
+    bool     c   = arm_carry();
     op.rhs       = val;
     op.cout      = c;
     if (sh) {
@@ -1071,42 +1138,28 @@ void CPU::arm_logic_tst(arm_data_t op)
 {
     arm_logic_set(op, op.lhs & op.rhs);
 }
-void CPU::arm_mpy_inc_cycles(uint64_t rhs, bool u)
-{
-    uint32_t m1 = rhs & 0xffffff00;
-    uint32_t m2 = rhs & 0xffff0000;
-    uint32_t m3 = rhs & 0xff000000;
-    if (m1 == 0 || (!u && m1 == 0xffffff00))
-        arm_cycles += 1;
-    else if (m2 == 0 || (!u && m2 == 0xffff0000))
-        arm_cycles += 2;
-    else if (m3 == 0 || (!u && m3 == 0xff000000))
-        arm_cycles += 3;
-    else
-        arm_cycles += 4;
-    arm_cycles_s_to_n();
-}
-void CPU::arm_mpy_add(arm_mpy_t op)
+void CPU::arm_mpy_inc_cycles(uint32_t rhs, bool u)
 {
-    uint32_t a     = arm_r.r[op.ra];
-    uint32_t res   = a + op.lhs * op.rhs;
-    arm_r.r[op.rd] = res;
-    if (op.s) {
-        arm_setn(res);
-        arm_setz(res);
-    }
-    arm_mpy_inc_cycles(op.rhs, ARM_MPY_SIGNED);
-    arm_cycles++;
+    // One cycle per significant byte of rhs, the signed forms also stop early on leading ones
+    if (!u)
+        rhs ^= (int32_t)rhs >> 31;
+    arm_cycles += (32 - __builtin_clz(rhs | 0xff) + 7) >> 3;
+    arm_cycles_s_to_n();
 }
-void CPU::arm_mpy(arm_mpy_t op)
-{
-    uint32_t res   = op.lhs * op.rhs;
-    arm_r.r[op.rd] = res;
-    if (op.s) {
-        arm_setn(res);
-        arm_setz(res);
+void CPU::arm_mpy_32(uint8_t rd, uint32_t lhs, uint32_t rhs, uint32_t acc, bool s)
+{
+    uint32_t res = acc + lhs * rhs;
+    arm_r.r[rd]  = res;
+    if (s) {
+        // N and Z only, C and V keep their values like a logic op with an unchanged carry
+        bool c = arm_carry();
+        if (flag_op != FLAGS_LOGIC)
+            arm_flags_sync();
+        flag_op  = FLAGS_LOGIC;
+        flag_lhs = c;
+        flag_res = res;
     }
-    arm_mpy_inc_cycles(op.rhs, ARM_MPY_SIGNED);
+    arm_mpy_inc_cycles(rhs, ARM_MPY_SIGNED);
 }
 void CPU::arm_mpy_smla__(arm_mpy_t op, bool m, bool n)
 {
@@ -1239,12 +1292,20 @@ void CPU::arm_mpy_umull(arm_mpy_t op)
 }
 void CPU::arm_memio_ldm(arm_memio_t op)
 {
-    uint8_t i;
+    uint8_t   i;
+    uint32_t *blk = gba->mem->arm_read_block(op.addr, arm_memio_reg_cnt(op.regs));
     arm_r.r[op.rn] += op.disp;
-    for (i = 0; i < 16; i++) {
-        if (op.regs & (1 << i)) {
-            arm_r.r[i] = gba->mem->arm_read_s(op.addr);
-            op.addr += 4;
+    if (blk) {
+        for (i = 0; i < 16; i++) {
+            if (op.regs & (1 << i))
+                arm_r.r[i] = *blk++;
+        }
+    } else {
+        for (i = 0; i < 16; i++) {
+            if (op.regs & (1 << i)) {
+                arm_r.r[i] = gba->mem->arm_read_s(op.addr);
+                op.addr += 4;
+            }
         }
     }
     if (op.regs & 0x8000) {
@@ -1269,11 +1330,15 @@ void CPU::arm_memio_ldm_usr(arm_memio_t op)
 }
 void CPU::arm_memio_stm(arm_memio_t op)
 {
-    bool    first = true;
-    uint8_t i;
+    bool      first = true;
+    uint8_t   i;
+    uint32_t *blk = gba->mem->arm_write_block(op.addr, arm_memio_reg_cnt(op.regs));
     for (i = 0; i < 16; i++) {
         if (op.regs & (1 << i)) {
-            gba->mem->arm_write_s(op.addr, arm_memio_reg_get(i));
+            if (blk)
+                *blk++ = arm_memio_reg_get(i);
+            else
+                gba->mem->arm_write_s(op.addr, arm_memio_reg_get(i));
             if (first) {
                 arm_r.r[op.rn] += op.disp;
                 first = false;
@@ -1428,6 +1493,7 @@ void CPU::arm_memio_strbt(arm_memio_t op)
 }
 void CPU::arm_psr_to_reg(arm_psr_t op)
 {
+    arm_flags_sync();
     if (op.r) {
         arm_spsr_get(&arm_r.r[op.rd]);
     } else {
@@ -1464,10 +1530,10 @@ void CPU::arm_reg_to_psr(arm_psr_t op)
     } else {
         int8_t curr = arm_r.cpsr & 0x1f;
         int8_t mode = op.psr & 0x1f;
+        arm_flags_sync();
         arm_r.cpsr &= ~mask;
         arm_r.cpsr |= op.psr;
-        arm_regs_to_bank(curr);
-        arm_bank_to_regs(mode);
+        arm_bank_swap(curr, mode);
         arm_check_irq();
     }
 }
@@ -1590,6 +1656,8 @@ void CPU::arm_b()
     int32_t imm = arm_op;
     imm <<= 8;
     imm >>= 6;
+    if (imm < 0 && idle_enb)
+        arm_idle_check(arm_r.r[15] + imm, arm_r.r[15] - 8);
     arm_r.r[15] += imm;
     arm_load_pipe();
 }
@@ -1598,6 +1666,8 @@ void CPU::t16_b_imm11()
     int32_t imm = arm_op;
     imm <<= 21;
     imm >>= 20;
+    if (imm < 0 && idle_enb)
+        arm_idle_check(arm_r.r[15] + imm, arm_r.r[15] - 4);
     arm_r.r[15] += imm;
     arm_load_pipe();
 }
@@ -1608,6 +1678,8 @@ void CPU::t16_b_imm8()
     imm >>= 23;
     int8_t cond = (arm_op >> 8) & 0xf;
     if (arm_cond(cond)) {
+        if (imm < 0 && idle_enb)
+            arm_idle_check(arm_r.r[15] + imm, arm_r.r[15] - 4);
         arm_r.r[15] += imm;
         arm_load_pipe();
     }
@@ -1925,7 +1997,9 @@ void CPU::arm_mcrr2()
 }
 void CPU::arm_mla()
 {
-    arm_mpy_add(arm_mpy_op());
+    arm_mpy_32((arm_op >> 16) & 0xf, arm_r.r[arm_op & 0xf], arm_r.r[(arm_op >> 8) & 0xf], arm_r.r[(arm_op >> 12) & 0xf],
+               (arm_op >> 20) & 1);
+    arm_cycles++;
 }
 void CPU::arm_mov_imm12()
 {
@@ -1991,11 +2065,11 @@ void CPU::arm_msr_reg()
 }
 void CPU::arm_mul()
 {
-    arm_mpy(arm_mpy_op());
+    arm_mpy_32((arm_op >> 16) & 0xf, arm_r.r[arm_op & 0xf], arm_r.r[(arm_op >> 8) & 0xf], 0, (arm_op >> 20) & 1);
 }
 void CPU::t16_mul()
 {
-    arm_mpy(t16_mpy_op());
+    arm_mpy_32(arm_op & 7, arm_r.r[arm_op & 7], arm_r.r[(arm_op >> 3) & 7], 0, true);
 }
 void CPU::arm_mvn_imm()
 {
@@ -2044,10 +2118,20 @@ void CPU::t16_pop()
     regs |= (arm_op << 7) & 0x8000;
     uint8_t i;
     arm_r.r[13] &= ~3;
-    for (i = 0; i < 16; i++) {
-        if (regs & (1 << i)) {
-            arm_r.r[i] = gba->mem->arm_read_s(arm_r.r[13]);
-            arm_r.r[13] += 4;
+    uint8_t   cnt = arm_memio_reg_cnt(regs);
+    uint32_t *blk = gba->mem->arm_read_block(arm_r.r[13], cnt);
+    if (blk) {
+        for (i = 0; i < 16; i++) {
+            if (regs & (1 << i))
+                arm_r.r[i] = *blk++;
+        }
+        arm_r.r[13] += cnt * 4;
+    } else {
+        for (i = 0; i < 16; i++) {
+            if (regs & (1 << i)) {
+                arm_r.r[i] = gba->mem->arm_read_s(arm_r.r[13]);
+                arm_r.r[13] += 4;
+            }
         }
     }
     if (regs & 0x8000) {
@@ -2060,16 +2144,17 @@ void CPU::t16_push()
     uint16_t regs;
     regs = (arm_op >> 0) & 0x00ff;
     regs |= (arm_op << 6) & 0x4000;
-    uint32_t addr = arm_r.r[13] & ~3;
-    uint8_t  i;
-    for (i = 0; i < 16; i++) {
-        if (regs & (1 << i))
-            addr -= 4;
-    }
+    uint8_t   cnt  = arm_memio_reg_cnt(regs);
+    uint32_t  addr = (arm_r.r[13] & ~3) - cnt * 4;
+    uint32_t *blk  = gba->mem->arm_write_block(addr, cnt);
+    uint8_t   i;
     arm_r.r[13] = addr;
     for (i = 0; i < 16; i++) {
         if (regs & (1 << i)) {
-            gba->mem->arm_write_s(addr, arm_memio_reg_get(i));
+            if (blk)
+                *blk++ = arm_memio_reg_get(i);
+            else
+                gba->mem->arm_write_s(addr, arm_memio_reg_get(i));
             addr += 4;
         }
     }
@@ -2290,10 +2375,14 @@ void CPU::t16_sub_sp7()
 }
 void CPU::arm_svc()
 {
+    if (hle_enb && gba->hle->hle_swi(arm_op >> 16))
+        return;
     arm_int(ARM_VEC_SVC, ARM_SVC);
 }
 void CPU::t16_svc()
 {
+    if (hle_enb && gba->hle->hle_swi(arm_op))
+        return;
     arm_int(ARM_VEC_SVC, ARM_SVC);
 }
 void CPU::arm_swp()
@@ -2352,8 +2441,149 @@ void CPU::arm_umull()
 }
 void CPU::arm_und()
 {
+#ifdef GBA_TRACE
+    printf("Undefined instruction %08x, last executed:\n", arm_op);
+    gba->trace->trace_dump(stdout, TRACE_DUMP_CNT);
+#endif
     arm_int(ARM_VEC_UND, ARM_UND);
 }
+template <uint8_t opc>
+void CPU::arm_dp(arm_data_t op)
+{
+    if constexpr (opc == 0x0)
+        arm_logic(op, AND);
+    else if constexpr (opc == 0x1)
+        arm_logic(op, EOR);
+    else if constexpr (opc == 0x2)
+        arm_arith_sub(op);
+    else if constexpr (opc == 0x3)
+        arm_arith_rsb(op);
+    else if constexpr (opc == 0x4)
+        arm_arith_add(op, ARM_ARITH_NO_C);
+    else if constexpr (opc == 0x5)
+        arm_arith_add(op, ARM_ARITH_CARRY);
+    else if constexpr (opc == 0x6)
+        arm_arith_sbc(op);
+    else if constexpr (opc == 0x7)
+        arm_arith_rsc(op);
+    else if constexpr (opc == 0x8)
+        arm_logic_tst(op);
+    else if constexpr (opc == 0x9)
+        arm_logic_teq(op);
+    else if constexpr (opc == 0xa)
+        arm_arith_cmp(op);
+    else if constexpr (opc == 0xb)
+        arm_arith_cmn(op);
+    else if constexpr (opc == 0xc)
+        arm_logic(op, ORR);
+    else if constexpr (opc == 0xd)
+        arm_logic(op, SHIFT);
+    else if constexpr (opc == 0xe)
+        arm_logic(op, BIC);
+    else
+        arm_logic(op, MVN);
+}
+// v = opcode << 1 | S, d reads the operands from the block cache entry
+template <uint32_t v, bool d>
+void CPU::arm_dp_imm()
+{
+    arm_dp<(v >> 1)>(arm_data_imm_op<(v & 1), d>());
+}
+// v = opcode << 3 | S << 2 | shift type
+template <uint32_t v, bool d>
+void CPU::arm_dp_regi()
+{
+    arm_dp<(v >> 3)>(arm_data_regi_op<((v >> 2) & 1), (v & 3), d>());
+}
+// v = P << 4 | U << 3 | B << 2 | W << 1 | L
+template <uint32_t v, bool d>
+void CPU::arm_memio_imm()
+{
+    arm_memio_t op = arm_memio_imm_op<((v >> 4) & 1), ((v >> 3) & 1), ((v >> 1) & 1), d>();
+    if constexpr ((v & 5) == 5)
+        arm_memio_ldrb(op);
+    else if constexpr (v & 1)
+        arm_memio_ldr(op);
+    else if constexpr (v & 4)
+        arm_memio_strb(op);
+    else
+        arm_memio_str(op);
+}
+// v = P << 6 | U << 5 | B << 4 | W << 3 | L << 2 | shift type
+template <uint32_t v, bool d>
+void CPU::arm_memio_reg()
+{
+    arm_memio_t op = arm_memio_reg_op<((v >> 6) & 1), ((v >> 5) & 1), ((v >> 3) & 1), (v & 3), d>();
+    if constexpr ((v & 0x14) == 0x14)
+        arm_memio_ldrb(op);
+    else if constexpr (v & 4)
+        arm_memio_ldr(op);
+    else if constexpr (v & 0x10)
+        arm_memio_strb(op);
+    else
+        arm_memio_str(op);
+}
+// v = MOV/CMP/ADD/SUB << 3 | Rdn
+template <uint32_t v, bool d>
+void CPU::t16_alu_imm8()
+{
+    constexpr uint8_t rdn = v & 7;
+    uint8_t           imm = d ? arm_dec->imm : (arm_op >> 0) & 0xff;
+    arm_data_t        op  = {.lhs = arm_r.r[rdn], .rhs = imm, .rd = rdn, .cout = false, .s = true};
+    if constexpr ((v >> 3) == 0) {
+        arm_r.r[rdn] = imm;
+        arm_setn(arm_r.r[rdn]);
+        arm_setz(arm_r.r[rdn]);
+    } else if constexpr ((v >> 3) == 1) {
+        arm_arith_cmp(op);
+    } else if constexpr ((v >> 3) == 2) {
+        arm_arith_add(op, ARM_ARITH_NO_C);
+    } else {
+        arm_arith_sub(op);
+    }
+}
+// v = LSL/LSR/ASR << 5 | imm5
+template <uint32_t v, bool d>
+void CPU::t16_shift_imm5()
+{
+    constexpr uint8_t kind = v >> 5;
+    constexpr uint8_t imm  = v & 0x1f;
+    uint8_t           rd   = d ? arm_dec->rd : (arm_op >> 0) & 0x7;
+    uint8_t           rn   = d ? arm_dec->rn : (arm_op >> 3) & 0x7;
+    arm_data_t        op   = {.lhs  = arm_r.r[rn],
+                              .rhs  = static_cast<uint64_t>((kind && imm == 0 ? 32 : imm)),
+                              .rd   = rd,
+                              .cout = false,
+                              .s    = true};
+    if constexpr (kind == 0)
+        arm_lsl(op);
+    else if constexpr (kind == 1)
+        arm_lsr(op);
+    else
+        arm_asr(op);
+}
+// v = STR/LDR/STRB/LDRB/STRH/LDRH << 5 | imm5
+template <uint32_t v, bool d>
+void CPU::t16_memio_imm5()
+{
+    constexpr uint8_t  kind = v >> 5;
+    constexpr uint32_t disp = (v & 0x1f) * (kind < 2 ? ARM_WORD_SZ : kind < 4 ? ARM_BYTE_SZ : ARM_HWORD_SZ);
+    uint8_t            rt   = d ? arm_dec->rd : (arm_op >> 0) & 0x7;
+    uint8_t            rn   = d ? arm_dec->rn : (arm_op >> 3) & 0x7;
+    arm_memio_t        op   = {.rt = rt, .addr = arm_r.r[rn] + disp};
+    if constexpr (kind == 0)
+        arm_memio_str(op);
+    else if constexpr (kind == 1)
+        arm_memio_ldr(op);
+    else if constexpr (kind == 2)
+        arm_memio_strb(op);
+    else if constexpr (kind == 3)
+        arm_memio_ldrb(op);
+    else if constexpr (kind == 4)
+        arm_memio_strh(op);
+    else
+        arm_memio_ldrh(op);
+}
 void CPU::arm_proc_fill(bool arm)
 {
     int32_t i;
@@ -2364,13 +2594,25 @@ void CPU::arm_proc_fill(bool arm)
         for (i = 0; i < 4096; i++) {
             arm_proc[1][i] = &CPU::arm_und;
         }
+#ifdef GBA_THREADED
+        for (i = 0; i < 4096; i++) {
+            arm_thread[0][i] = &CPU::arm_thread_op<&CPU::arm_und, false>;
+            arm_thread[1][i] = &CPU::arm_thread_op<&CPU::arm_und, false>;
+        }
+#endif
     } else {
         for (i = 0; i < 2048; i++) {
             thumb_proc[i] = &CPU::arm_und;
         }
+#ifdef GBA_THREADED
+        for (i = 0; i < 2048; i++) {
+            t16_thread[i] = &CPU::arm_thread_op<&CPU::arm_und, true>;
+        }
+#endif
     }
 }
-void CPU::arm_proc_set(bool arm, int idx, arm_proc_t proc, uint32_t op, uint32_t mask, int32_t bits)
+// Lists every table slot that matches op under mask, returns how many
+int32_t CPU::arm_proc_slots(uint32_t op, uint32_t mask, int32_t bits, uint16_t *slots)
 {
     int32_t i, j;
     int32_t zbits = 0;
@@ -2381,239 +2623,439 @@ void CPU::arm_proc_set(bool arm, int idx, arm_proc_t proc, uint32_t op, uint32_t
             zpos[zbits++] = i;
     }
 
+    for (i = 0; i < (1 << zbits); i++) {
+        op &= mask;
+        for (j = 0; j < zbits; j++) {
+            op |= ((i >> j) & 1) << zpos[j];
+        }
+        slots[i] = op;
+    }
+    return 1 << zbits;
+}
+template <CPU::arm_proc_t proc>
+void CPU::arm_proc_set(bool arm, int idx, const char *name, uint32_t op, uint32_t mask, int32_t bits)
+{
+    uint16_t slots[4096];
+    int32_t  cnt = arm_proc_slots(op, mask, bits, slots);
+    int32_t  i;
+
+    for (i = 0; i < cnt; i++) {
+        if (arm)
+            arm_proc[idx][slots[i]] = proc;
+        else
+            thumb_proc[slots[i]] = proc;
+#ifdef GBA_THREADED
+        if (arm)
+            arm_thread[idx][slots[i]] = &CPU::arm_thread_op<proc, false>;
+        else
+            t16_thread[slots[i]] = &CPU::arm_thread_op<proc, true>;
+#endif
+    }
+#ifdef GBA_PROFILE
+    // The specialized handlers swapped in later keep the name of the slot they replace
+    arm_prof_name(arm, idx, proc, name);
+#endif
+}
+#ifdef GBA_PROFILE
+#define PROF_TOP_PCS 32
+
+// Counts the instruction around it against its table slot and address, nothing is left without GBA_PROFILE
+#define PROF_BEGIN(thumb) \
+    uint32_t prof_pc = arm_r.r[15] - ((thumb) ? 4 : 8), prof_cycles = arm_cycles
+#define PROF_END(thumb) arm_prof_add(thumb, prof_pc, arm_cycles - prof_cycles)
+
+// Cycles an idle loop fast-forward skips are kept apart from the branch that triggered it
+#define PROF_IDLE(cycles) prof_idle_pend += cycles
+
+void CPU::arm_prof_name(bool arm, int idx, arm_proc_t proc, const char *name)
+{
+    int32_t i;
     if (arm) {
-        for (i = 0; i < (1 << zbits); i++) {
-            op &= mask;
-            for (j = 0; j < zbits; j++) {
-                op |= ((i >> j) & 1) << zpos[j];
-            }
-            arm_proc[idx][op] = proc;
+        for (i = 0; i < 4096; i++) {
+            if (arm_proc[idx][i] == proc)
+                prof_arm_name[idx][i] = name;
         }
     } else {
-        for (i = 0; i < (1 << zbits); i++) {
-            op &= mask;
-            for (j = 0; j < zbits; j++) {
-                op |= ((i >> j) & 1) << zpos[j];
-            }
-            thumb_proc[op] = proc;
+        for (i = 0; i < 2048; i++) {
+            if (thumb_proc[i] == proc)
+                prof_t16_name[i] = name;
         }
     }
 }
+void CPU::arm_prof_add(bool thumb, uint32_t pc, uint32_t cycles)
+{
+    arm_prof_t *ent;
+    if (thumb)
+        ent = &prof_t16[arm_op >> 5];
+    else
+        ent = &prof_arm[(arm_op >> 28) == ARM_COND_UNCOND][((arm_op >> 16) & 0xff0) | ((arm_op >> 4) & 0xf)];
+    ent->insts++;
+    ent->cycles += cycles - prof_idle_pend;
+    prof_idle += prof_idle_pend;
+    prof_idle_pend = 0;
+    prof_pc[pc | thumb]++;
+}
+void CPU::arm_prof_report()
+{
+    std::map<std::string, arm_prof_t> by_name;
+    uint64_t                          insts = 0, cycles = 0;
+    int32_t                           i;
+    // Slots nobody registered still hold arm_und from arm_proc_fill
+    for (i = 0; i < 2 * 4096; i++) {
+        const char *name = prof_arm_name[i >> 12][i & 0xfff];
+        arm_prof_t *ent  = &by_name[name ? name : "arm_und"];
+        ent->insts += prof_arm[i >> 12][i & 0xfff].insts;
+        ent->cycles += prof_arm[i >> 12][i & 0xfff].cycles;
+    }
+    for (i = 0; i < 2048; i++) {
+        arm_prof_t *ent = &by_name[prof_t16_name[i] ? prof_t16_name[i] : "arm_und"];
+        ent->insts += prof_t16[i].insts;
+        ent->cycles += prof_t16[i].cycles;
+    }
+    for (auto &it : by_name) {
+        insts += it.second.insts;
+        cycles += it.second.cycles;
+    }
+    if (!insts)
+        return;
+
+    std::vector<std::pair<std::string, arm_prof_t>> hot(by_name.begin(), by_name.end());
+    std::sort(hot.begin(), hot.end(), [](const auto &a, const auto &b) { return a.second.insts > b.second.insts; });
+    printf("Profile: %llu instructions, %llu cycles\n", (unsigned long long)insts, (unsigned long long)cycles);
+    printf("  idle loops skipped: %llu cycles, %.1f%% of all cycles\n", (unsigned long long)prof_idle,
+           100.0 * prof_idle / (cycles + prof_idle));
+    for (auto &it : hot) {
+        if (!it.second.insts)
+            break;
+        printf("  %-16s: %5.1f%% of instructions, %5.1f%% of cycles, %.2f cycles each\n", it.first.c_str(),
+               100.0 * it.second.insts / insts, 100.0 * it.second.cycles / cycles,
+               (double)it.second.cycles / it.second.insts);
+    }
+
+    std::vector<std::pair<uint32_t, uint64_t>> pcs(prof_pc.begin(), prof_pc.end());
+    size_t                                     top = std::min(pcs.size(), (size_t)PROF_TOP_PCS);
+    std::partial_sort(pcs.begin(), pcs.begin() + top, pcs.end(),
+                      [](const auto &a, const auto &b) { return a.second > b.second; });
+    printf("Hottest addresses:\n");
+    for (size_t n = 0; n < top; n++)
+        printf("  %08x %s: %5.1f%% of instructions\n", pcs[n].first & ~1, pcs[n].first & 1 ? "thumb" : "arm  ",
+               100.0 * pcs[n].second / insts);
+}
+#else
+#define PROF_BEGIN(thumb)
+#define PROF_END(thumb)
+#define PROF_IDLE(cycles)
+#endif
+#ifdef GBA_TRACE
+// Records the instruction at the head of the pipeline before it runs, nothing is left without GBA_TRACE
+#define TRACE_ADD(thumb) arm_trace_add(thumb)
+
+void CPU::arm_trace_add(bool thumb)
+{
+    // Pending lazy flags are folded in so the recorded CPSR is exact
+    arm_flags_sync();
+    gba->trace->trace_add((arm_r.r[15] - (thumb ? 4 : 8)) | thumb, arm_pipe[0], arm_r.cpsr,
+                          gba->sched->sched_cycles());
+}
+#else
+#define TRACE_ADD(thumb)
+#endif
 void CPU::arm_proc_init()
 {
     arm_proc_fill(true);
-    arm_proc_set(true, 0, &CPU::arm_adc_imm, 0b001010100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_adc_regi, 0b000010100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_adc_regr, 0b000010100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_add_imm, 0b001010000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_add_regi, 0b000010000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_add_regr, 0b000010000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_and_imm, 0b001000000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_and_regi, 0b000000000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_and_regr, 0b000000000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_shift_imm, 0b000110100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_shift_reg, 0b000110100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_b, 0b101000000000, 0b111100000000, 12);
-    arm_proc_set(true, 0, &CPU::arm_bic_imm, 0b001111000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_bic_regi, 0b000111000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_bic_regr, 0b000111000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_bkpt, 0b000100100111, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_bl, 0b101100000000, 0b111100000000, 12);
-    arm_proc_set(true, 0, &CPU::arm_blx_reg, 0b000100100011, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_bx, 0b000100100001, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_cdp, 0b111000000000, 0b111100000001, 12);
-    arm_proc_set(true, 0, &CPU::arm_clz, 0b000101100001, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmn_imm, 0b001101110000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmn_regi, 0b000101110000, 0b111111110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmn_regr, 0b000101110001, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmp_imm, 0b001101010000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmp_regi, 0b000101010000, 0b111111110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_cmp_regr, 0b000101010001, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_eor_imm, 0b001000100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_eor_regi, 0b000000100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_eor_regr, 0b000000100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldc, 0b110000010000, 0b111000010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldm, 0b100000010000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldm_usr, 0b100001010000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldr_imm, 0b010000010000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldr_reg, 0b011000010000, 0b111001010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrb_imm, 0b010001010000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrb_reg, 0b011001010000, 0b111001010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrbt_imm, 0b010001110000, 0b111101110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrbt_reg, 0b011001110000, 0b111101110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrd_imm, 0b000001001101, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrd_reg, 0b000000001101, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrh_imm, 0b000001011011, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrh_reg, 0b000000011011, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrsb_imm, 0b000001011101, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrsb_reg, 0b000000011101, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrsh_imm, 0b000001011111, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_ldrsh_reg, 0b000000011111, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_mcr, 0b111000000001, 0b111100010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_mcrr, 0b110001000000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_mla, 0b000000101001, 0b111111101111, 12);
-    arm_proc_set(true, 0, &CPU::arm_mov_imm12, 0b001110100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_mrc, 0b111000010001, 0b111100010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_mrrc, 0b110001010000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_mrs, 0b000100000000, 0b111110111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_msr_imm, 0b001100100000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_msr_reg, 0b000100100000, 0b111110111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_mul, 0b000000001001, 0b111111101111, 12);
-    arm_proc_set(true, 0, &CPU::arm_mvn_imm, 0b001111100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_mvn_regi, 0b000111100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_mvn_regr, 0b000111100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_orr_imm, 0b001110000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_orr_regi, 0b000110000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_orr_regr, 0b000110000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_qadd, 0b000100000101, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_qdadd, 0b000101000101, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_qdsub, 0b000101100101, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_qsub, 0b000100100101, 0b111111111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsb_imm, 0b001001100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsb_regi, 0b000001100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsb_regr, 0b000001100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsc_imm, 0b001011100000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsc_regi, 0b000011100000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_rsc_regr, 0b000011100001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_sbc_imm, 0b001011000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_sbc_regi, 0b000011000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_sbc_regr, 0b000011000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_smla__, 0b000100001000, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_smlal, 0b000011101001, 0b111111101111, 12);
-    arm_proc_set(true, 0, &CPU::arm_smlal__, 0b000101001000, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_smlaw_, 0b000100101000, 0b111111111011, 12);
-    arm_proc_set(true, 0, &CPU::arm_smul, 0b000101101000, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_smull, 0b000011001001, 0b111111101111, 12);
-    arm_proc_set(true, 0, &CPU::arm_smulw_, 0b000100101010, 0b111111111011, 12);
-    arm_proc_set(true, 0, &CPU::arm_stc, 0b110000000000, 0b111000010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_stm, 0b100000000000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_stm_usr, 0b100001000000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_str_imm, 0b010000000000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_str_reg, 0b011000000000, 0b111001010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_strb_imm, 0b010001000000, 0b111001010000, 12);
-    arm_proc_set(true, 0, &CPU::arm_strb_reg, 0b011001000000, 0b111001010001, 12);
-    arm_proc_set(true, 0, &CPU::arm_strbt_imm, 0b010001100000, 0b111101110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_strbt_reg, 0b011001100000, 0b111101110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_strd_imm, 0b000001001111, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_strd_reg, 0b000000001111, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_strh_imm, 0b000001001011, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_strh_reg, 0b000000001011, 0b111001011111, 12);
-    arm_proc_set(true, 0, &CPU::arm_sub_imm, 0b001001000000, 0b111111100000, 12);
-    arm_proc_set(true, 0, &CPU::arm_sub_regi, 0b000001000000, 0b111111100001, 12);
-    arm_proc_set(true, 0, &CPU::arm_sub_regr, 0b000001000001, 0b111111101001, 12);
-    arm_proc_set(true, 0, &CPU::arm_svc, 0b111100000000, 0b111100000000, 12);
-    arm_proc_set(true, 0, &CPU::arm_swp, 0b000100001001, 0b111110111111, 12);
-    arm_proc_set(true, 0, &CPU::arm_teq_imm, 0b001100110000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_teq_regi, 0b000100110000, 0b111111110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_teq_regr, 0b000100110001, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_tst_imm, 0b001100010000, 0b111111110000, 12);
-    arm_proc_set(true, 0, &CPU::arm_tst_regi, 0b000100010000, 0b111111110001, 12);
-    arm_proc_set(true, 0, &CPU::arm_tst_regr, 0b000100010001, 0b111111111001, 12);
-    arm_proc_set(true, 0, &CPU::arm_umlal, 0b000010101001, 0b111111101111, 12);
-    arm_proc_set(true, 0, &CPU::arm_umull, 0b000010001001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_adc_imm>(true, 0, "arm_adc_imm", 0b001010100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_adc_regi>(true, 0, "arm_adc_regi", 0b000010100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_adc_regr>(true, 0, "arm_adc_regr", 0b000010100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_add_imm>(true, 0, "arm_add_imm", 0b001010000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_add_regi>(true, 0, "arm_add_regi", 0b000010000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_add_regr>(true, 0, "arm_add_regr", 0b000010000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_and_imm>(true, 0, "arm_and_imm", 0b001000000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_and_regi>(true, 0, "arm_and_regi", 0b000000000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_and_regr>(true, 0, "arm_and_regr", 0b000000000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_shift_imm>(true, 0, "arm_shift_imm", 0b000110100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_shift_reg>(true, 0, "arm_shift_reg", 0b000110100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_b>(true, 0, "arm_b", 0b101000000000, 0b111100000000, 12);
+    arm_proc_set<&CPU::arm_bic_imm>(true, 0, "arm_bic_imm", 0b001111000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_bic_regi>(true, 0, "arm_bic_regi", 0b000111000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_bic_regr>(true, 0, "arm_bic_regr", 0b000111000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_bkpt>(true, 0, "arm_bkpt", 0b000100100111, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_bl>(true, 0, "arm_bl", 0b101100000000, 0b111100000000, 12);
+    arm_proc_set<&CPU::arm_blx_reg>(true, 0, "arm_blx_reg", 0b000100100011, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_bx>(true, 0, "arm_bx", 0b000100100001, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_cdp>(true, 0, "arm_cdp", 0b111000000000, 0b111100000001, 12);
+    arm_proc_set<&CPU::arm_clz>(true, 0, "arm_clz", 0b000101100001, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_cmn_imm>(true, 0, "arm_cmn_imm", 0b001101110000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_cmn_regi>(true, 0, "arm_cmn_regi", 0b000101110000, 0b111111110001, 12);
+    arm_proc_set<&CPU::arm_cmn_regr>(true, 0, "arm_cmn_regr", 0b000101110001, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_cmp_imm>(true, 0, "arm_cmp_imm", 0b001101010000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_cmp_regi>(true, 0, "arm_cmp_regi", 0b000101010000, 0b111111110001, 12);
+    arm_proc_set<&CPU::arm_cmp_regr>(true, 0, "arm_cmp_regr", 0b000101010001, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_eor_imm>(true, 0, "arm_eor_imm", 0b001000100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_eor_regi>(true, 0, "arm_eor_regi", 0b000000100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_eor_regr>(true, 0, "arm_eor_regr", 0b000000100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_ldc>(true, 0, "arm_ldc", 0b110000010000, 0b111000010000, 12);
+    arm_proc_set<&CPU::arm_ldm>(true, 0, "arm_ldm", 0b100000010000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_ldm_usr>(true, 0, "arm_ldm_usr", 0b100001010000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_ldr_imm>(true, 0, "arm_ldr_imm", 0b010000010000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_ldr_reg>(true, 0, "arm_ldr_reg", 0b011000010000, 0b111001010001, 12);
+    arm_proc_set<&CPU::arm_ldrb_imm>(true, 0, "arm_ldrb_imm", 0b010001010000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_ldrb_reg>(true, 0, "arm_ldrb_reg", 0b011001010000, 0b111001010001, 12);
+    arm_proc_set<&CPU::arm_ldrbt_imm>(true, 0, "arm_ldrbt_imm", 0b010001110000, 0b111101110000, 12);
+    arm_proc_set<&CPU::arm_ldrbt_reg>(true, 0, "arm_ldrbt_reg", 0b011001110000, 0b111101110001, 12);
+    arm_proc_set<&CPU::arm_ldrd_imm>(true, 0, "arm_ldrd_imm", 0b000001001101, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrd_reg>(true, 0, "arm_ldrd_reg", 0b000000001101, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrh_imm>(true, 0, "arm_ldrh_imm", 0b000001011011, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrh_reg>(true, 0, "arm_ldrh_reg", 0b000000011011, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrsb_imm>(true, 0, "arm_ldrsb_imm", 0b000001011101, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrsb_reg>(true, 0, "arm_ldrsb_reg", 0b000000011101, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrsh_imm>(true, 0, "arm_ldrsh_imm", 0b000001011111, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_ldrsh_reg>(true, 0, "arm_ldrsh_reg", 0b000000011111, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_mcr>(true, 0, "arm_mcr", 0b111000000001, 0b111100010001, 12);
+    arm_proc_set<&CPU::arm_mcrr>(true, 0, "arm_mcrr", 0b110001000000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_mla>(true, 0, "arm_mla", 0b000000101001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_mov_imm12>(true, 0, "arm_mov_imm12", 0b001110100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_mrc>(true, 0, "arm_mrc", 0b111000010001, 0b111100010001, 12);
+    arm_proc_set<&CPU::arm_mrrc>(true, 0, "arm_mrrc", 0b110001010000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_mrs>(true, 0, "arm_mrs", 0b000100000000, 0b111110111111, 12);
+    arm_proc_set<&CPU::arm_msr_imm>(true, 0, "arm_msr_imm", 0b001100100000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_msr_reg>(true, 0, "arm_msr_reg", 0b000100100000, 0b111110111111, 12);
+    arm_proc_set<&CPU::arm_mul>(true, 0, "arm_mul", 0b000000001001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_mvn_imm>(true, 0, "arm_mvn_imm", 0b001111100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_mvn_regi>(true, 0, "arm_mvn_regi", 0b000111100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_mvn_regr>(true, 0, "arm_mvn_regr", 0b000111100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_orr_imm>(true, 0, "arm_orr_imm", 0b001110000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_orr_regi>(true, 0, "arm_orr_regi", 0b000110000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_orr_regr>(true, 0, "arm_orr_regr", 0b000110000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_qadd>(true, 0, "arm_qadd", 0b000100000101, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_qdadd>(true, 0, "arm_qdadd", 0b000101000101, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_qdsub>(true, 0, "arm_qdsub", 0b000101100101, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_qsub>(true, 0, "arm_qsub", 0b000100100101, 0b111111111111, 12);
+    arm_proc_set<&CPU::arm_rsb_imm>(true, 0, "arm_rsb_imm", 0b001001100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_rsb_regi>(true, 0, "arm_rsb_regi", 0b000001100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_rsb_regr>(true, 0, "arm_rsb_regr", 0b000001100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_rsc_imm>(true, 0, "arm_rsc_imm", 0b001011100000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_rsc_regi>(true, 0, "arm_rsc_regi", 0b000011100000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_rsc_regr>(true, 0, "arm_rsc_regr", 0b000011100001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_sbc_imm>(true, 0, "arm_sbc_imm", 0b001011000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_sbc_regi>(true, 0, "arm_sbc_regi", 0b000011000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_sbc_regr>(true, 0, "arm_sbc_regr", 0b000011000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_smla__>(true, 0, "arm_smla__", 0b000100001000, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_smlal>(true, 0, "arm_smlal", 0b000011101001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_smlal__>(true, 0, "arm_smlal__", 0b000101001000, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_smlaw_>(true, 0, "arm_smlaw_", 0b000100101000, 0b111111111011, 12);
+    arm_proc_set<&CPU::arm_smul>(true, 0, "arm_smul", 0b000101101000, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_smull>(true, 0, "arm_smull", 0b000011001001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_smulw_>(true, 0, "arm_smulw_", 0b000100101010, 0b111111111011, 12);
+    arm_proc_set<&CPU::arm_stc>(true, 0, "arm_stc", 0b110000000000, 0b111000010000, 12);
+    arm_proc_set<&CPU::arm_stm>(true, 0, "arm_stm", 0b100000000000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_stm_usr>(true, 0, "arm_stm_usr", 0b100001000000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_str_imm>(true, 0, "arm_str_imm", 0b010000000000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_str_reg>(true, 0, "arm_str_reg", 0b011000000000, 0b111001010001, 12);
+    arm_proc_set<&CPU::arm_strb_imm>(true, 0, "arm_strb_imm", 0b010001000000, 0b111001010000, 12);
+    arm_proc_set<&CPU::arm_strb_reg>(true, 0, "arm_strb_reg", 0b011001000000, 0b111001010001, 12);
+    arm_proc_set<&CPU::arm_strbt_imm>(true, 0, "arm_strbt_imm", 0b010001100000, 0b111101110000, 12);
+    arm_proc_set<&CPU::arm_strbt_reg>(true, 0, "arm_strbt_reg", 0b011001100000, 0b111101110001, 12);
+    arm_proc_set<&CPU::arm_strd_imm>(true, 0, "arm_strd_imm", 0b000001001111, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_strd_reg>(true, 0, "arm_strd_reg", 0b000000001111, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_strh_imm>(true, 0, "arm_strh_imm", 0b000001001011, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_strh_reg>(true, 0, "arm_strh_reg", 0b000000001011, 0b111001011111, 12);
+    arm_proc_set<&CPU::arm_sub_imm>(true, 0, "arm_sub_imm", 0b001001000000, 0b111111100000, 12);
+    arm_proc_set<&CPU::arm_sub_regi>(true, 0, "arm_sub_regi", 0b000001000000, 0b111111100001, 12);
+    arm_proc_set<&CPU::arm_sub_regr>(true, 0, "arm_sub_regr", 0b000001000001, 0b111111101001, 12);
+    arm_proc_set<&CPU::arm_svc>(true, 0, "arm_svc", 0b111100000000, 0b111100000000, 12);
+    arm_proc_set<&CPU::arm_swp>(true, 0, "arm_swp", 0b000100001001, 0b111110111111, 12);
+    arm_proc_set<&CPU::arm_teq_imm>(true, 0, "arm_teq_imm", 0b001100110000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_teq_regi>(true, 0, "arm_teq_regi", 0b000100110000, 0b111111110001, 12);
+    arm_proc_set<&CPU::arm_teq_regr>(true, 0, "arm_teq_regr", 0b000100110001, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_tst_imm>(true, 0, "arm_tst_imm", 0b001100010000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_tst_regi>(true, 0, "arm_tst_regi", 0b000100010000, 0b111111110001, 12);
+    arm_proc_set<&CPU::arm_tst_regr>(true, 0, "arm_tst_regr", 0b000100010001, 0b111111111001, 12);
+    arm_proc_set<&CPU::arm_umlal>(true, 0, "arm_umlal", 0b000010101001, 0b111111101111, 12);
+    arm_proc_set<&CPU::arm_umull>(true, 0, "arm_umull", 0b000010001001, 0b111111101111, 12);
 
     // // Unconditional
-    arm_proc_set(true, 1, &CPU::arm_blx_imm, 0b101000000000, 0b111000000000, 12);
-    arm_proc_set(true, 1, &CPU::arm_cdp2, 0b111000000000, 0b111100000001, 12);
-    arm_proc_set(true, 1, &CPU::arm_ldc2, 0b110000010000, 0b111000010000, 12);
-    arm_proc_set(true, 1, &CPU::arm_mcr2, 0b111000000001, 0b111100010001, 12);
-    arm_proc_set(true, 1, &CPU::arm_mcrr2, 0b110001000000, 0b111111110000, 12);
-    arm_proc_set(true, 1, &CPU::arm_mrc2, 0b111000010001, 0b111100010001, 12);
-    arm_proc_set(true, 1, &CPU::arm_mrrc2, 0b110001010000, 0b111111110000, 12);
-    arm_proc_set(true, 1, &CPU::arm_pld_imm, 0b010101010000, 0b111101110000, 12);
-    arm_proc_set(true, 1, &CPU::arm_pld_reg, 0b011101010000, 0b111101110000, 12);
-    arm_proc_set(true, 1, &CPU::arm_stc2, 0b110000000000, 0b111000010000, 12);
+    arm_proc_set<&CPU::arm_blx_imm>(true, 1, "arm_blx_imm", 0b101000000000, 0b111000000000, 12);
+    arm_proc_set<&CPU::arm_cdp2>(true, 1, "arm_cdp2", 0b111000000000, 0b111100000001, 12);
+    arm_proc_set<&CPU::arm_ldc2>(true, 1, "arm_ldc2", 0b110000010000, 0b111000010000, 12);
+    arm_proc_set<&CPU::arm_mcr2>(true, 1, "arm_mcr2", 0b111000000001, 0b111100010001, 12);
+    arm_proc_set<&CPU::arm_mcrr2>(true, 1, "arm_mcrr2", 0b110001000000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_mrc2>(true, 1, "arm_mrc2", 0b111000010001, 0b111100010001, 12);
+    arm_proc_set<&CPU::arm_mrrc2>(true, 1, "arm_mrrc2", 0b110001010000, 0b111111110000, 12);
+    arm_proc_set<&CPU::arm_pld_imm>(true, 1, "arm_pld_imm", 0b010101010000, 0b111101110000, 12);
+    arm_proc_set<&CPU::arm_pld_reg>(true, 1, "arm_pld_reg", 0b011101010000, 0b111101110000, 12);
+    arm_proc_set<&CPU::arm_stc2>(true, 1, "arm_stc2", 0b110000000000, 0b111000010000, 12);
 }
 void CPU::thumb_proc_init()
 {
     arm_proc_fill(false);
-    arm_proc_set(false, 0, &CPU::t16_adc_rdn3, 0b01000001010, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_imm3, 0b00011100000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_imm8, 0b00110000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_reg, 0b00011000000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_rdn4, 0b01000100000, 0b11111111000, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_sp7, 0b10110000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_add_sp8, 0b10101000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_adr, 0b10100000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_and_rdn3, 0b01000000000, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_asr_imm5, 0b00010000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_asr_rdn3, 0b01000001000, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_b_imm8, 0b11010000000, 0b11110000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_b_imm11, 0b11100000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_bic_rdn3, 0b01000011100, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_bkpt, 0b10111110000, 0b11111111000, 11);
-    arm_proc_set(false, 0, &CPU::t16_blx, 0b01000111100, 0b11111111100, 11);
-    arm_proc_set(false, 0, &CPU::t16_blx_h1, 0b11101000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_blx_h2, 0b11110000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_blx_h3, 0b11111000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_bx, 0b01000111000, 0b11111111100, 11);
-    arm_proc_set(false, 0, &CPU::t16_cmn_rdn3, 0b01000010110, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_cmp_imm8, 0b00101000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_cmp_rdn3, 0b01000010100, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_cmp_rdn4, 0b01000101000, 0b11111111000, 11);
-    arm_proc_set(false, 0, &CPU::t16_eor_rdn3, 0b01000000010, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldm, 0b11001000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldr_imm5, 0b01101000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldr_sp8, 0b10011000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldr_pc8, 0b01001000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldr_reg, 0b01011000000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrb_imm5, 0b01111000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrb_reg, 0b01011100000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrh_imm5, 0b10001000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrh_reg, 0b01011010000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrsb_reg, 0b01010110000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ldrsh_reg, 0b01011110000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_lsl_imm5, 0b00000000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_lsl_rdn3, 0b01000000100, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_lsr_imm5, 0b00001000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_lsr_rdn3, 0b01000000110, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_mov_imm, 0b00100000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_mov_rd4, 0b01000110000, 0b11111111000, 11);
-    arm_proc_set(false, 0, &CPU::t16_mov_rd3, 0b00000000000, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_mul, 0b01000011010, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_mvn_rdn3, 0b01000011110, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_orr_rdn3, 0b01000011000, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_pop, 0b10111100000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_push, 0b10110100000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_ror, 0b01000001110, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_rsb_rdn3, 0b01000010010, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_sbc_rdn3, 0b01000001100, 0b11111111110, 11);
-    arm_proc_set(false, 0, &CPU::t16_stm, 0b11000000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_str_imm5, 0b01100000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_str_sp8, 0b10010000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_str_reg, 0b01010000000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_strb_imm5, 0b01110000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_strb_reg, 0b01010100000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_strh_imm5, 0b10000000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_strh_reg, 0b01010010000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_sub_imm3, 0b00011110000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_sub_imm8, 0b00111000000, 0b11111000000, 11);
-    arm_proc_set(false, 0, &CPU::t16_sub_reg, 0b00011010000, 0b11111110000, 11);
-    arm_proc_set(false, 0, &CPU::t16_sub_sp7, 0b10110000100, 0b11111111100, 11);
-    arm_proc_set(false, 0, &CPU::t16_svc, 0b11011111100, 0b11111111000, 11);
-    arm_proc_set(false, 0, &CPU::t16_tst_rdn3, 0b01000010000, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_adc_rdn3>(false, 0, "t16_adc_rdn3", 0b01000001010, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_add_imm3>(false, 0, "t16_add_imm3", 0b00011100000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_add_imm8>(false, 0, "t16_add_imm8", 0b00110000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_add_reg>(false, 0, "t16_add_reg", 0b00011000000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_add_rdn4>(false, 0, "t16_add_rdn4", 0b01000100000, 0b11111111000, 11);
+    arm_proc_set<&CPU::t16_add_sp7>(false, 0, "t16_add_sp7", 0b10110000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_add_sp8>(false, 0, "t16_add_sp8", 0b10101000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_adr>(false, 0, "t16_adr", 0b10100000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_and_rdn3>(false, 0, "t16_and_rdn3", 0b01000000000, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_asr_imm5>(false, 0, "t16_asr_imm5", 0b00010000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_asr_rdn3>(false, 0, "t16_asr_rdn3", 0b01000001000, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_b_imm8>(false, 0, "t16_b_imm8", 0b11010000000, 0b11110000000, 11);
+    arm_proc_set<&CPU::t16_b_imm11>(false, 0, "t16_b_imm11", 0b11100000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_bic_rdn3>(false, 0, "t16_bic_rdn3", 0b01000011100, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_bkpt>(false, 0, "t16_bkpt", 0b10111110000, 0b11111111000, 11);
+    arm_proc_set<&CPU::t16_blx>(false, 0, "t16_blx", 0b01000111100, 0b11111111100, 11);
+    arm_proc_set<&CPU::t16_blx_h1>(false, 0, "t16_blx_h1", 0b11101000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_blx_h2>(false, 0, "t16_blx_h2", 0b11110000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_blx_h3>(false, 0, "t16_blx_h3", 0b11111000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_bx>(false, 0, "t16_bx", 0b01000111000, 0b11111111100, 11);
+    arm_proc_set<&CPU::t16_cmn_rdn3>(false, 0, "t16_cmn_rdn3", 0b01000010110, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_cmp_imm8>(false, 0, "t16_cmp_imm8", 0b00101000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_cmp_rdn3>(false, 0, "t16_cmp_rdn3", 0b01000010100, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_cmp_rdn4>(false, 0, "t16_cmp_rdn4", 0b01000101000, 0b11111111000, 11);
+    arm_proc_set<&CPU::t16_eor_rdn3>(false, 0, "t16_eor_rdn3", 0b01000000010, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_ldm>(false, 0, "t16_ldm", 0b11001000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldr_imm5>(false, 0, "t16_ldr_imm5", 0b01101000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldr_sp8>(false, 0, "t16_ldr_sp8", 0b10011000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldr_pc8>(false, 0, "t16_ldr_pc8", 0b01001000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldr_reg>(false, 0, "t16_ldr_reg", 0b01011000000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_ldrb_imm5>(false, 0, "t16_ldrb_imm5", 0b01111000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldrb_reg>(false, 0, "t16_ldrb_reg", 0b01011100000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_ldrh_imm5>(false, 0, "t16_ldrh_imm5", 0b10001000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_ldrh_reg>(false, 0, "t16_ldrh_reg", 0b01011010000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_ldrsb_reg>(false, 0, "t16_ldrsb_reg", 0b01010110000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_ldrsh_reg>(false, 0, "t16_ldrsh_reg", 0b01011110000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_lsl_imm5>(false, 0, "t16_lsl_imm5", 0b00000000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_lsl_rdn3>(false, 0, "t16_lsl_rdn3", 0b01000000100, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_lsr_imm5>(false, 0, "t16_lsr_imm5", 0b00001000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_lsr_rdn3>(false, 0, "t16_lsr_rdn3", 0b01000000110, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_mov_imm>(false, 0, "t16_mov_imm", 0b00100000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_mov_rd4>(false, 0, "t16_mov_rd4", 0b01000110000, 0b11111111000, 11);
+    arm_proc_set<&CPU::t16_mov_rd3>(false, 0, "t16_mov_rd3", 0b00000000000, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_mul>(false, 0, "t16_mul", 0b01000011010, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_mvn_rdn3>(false, 0, "t16_mvn_rdn3", 0b01000011110, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_orr_rdn3>(false, 0, "t16_orr_rdn3", 0b01000011000, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_pop>(false, 0, "t16_pop", 0b10111100000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_push>(false, 0, "t16_push", 0b10110100000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_ror>(false, 0, "t16_ror", 0b01000001110, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_rsb_rdn3>(false, 0, "t16_rsb_rdn3", 0b01000010010, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_sbc_rdn3>(false, 0, "t16_sbc_rdn3", 0b01000001100, 0b11111111110, 11);
+    arm_proc_set<&CPU::t16_stm>(false, 0, "t16_stm", 0b11000000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_str_imm5>(false, 0, "t16_str_imm5", 0b01100000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_str_sp8>(false, 0, "t16_str_sp8", 0b10010000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_str_reg>(false, 0, "t16_str_reg", 0b01010000000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_strb_imm5>(false, 0, "t16_strb_imm5", 0b01110000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_strb_reg>(false, 0, "t16_strb_reg", 0b01010100000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_strh_imm5>(false, 0, "t16_strh_imm5", 0b10000000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_strh_reg>(false, 0, "t16_strh_reg", 0b01010010000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_sub_imm3>(false, 0, "t16_sub_imm3", 0b00011110000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_sub_imm8>(false, 0, "t16_sub_imm8", 0b00111000000, 0b11111000000, 11);
+    arm_proc_set<&CPU::t16_sub_reg>(false, 0, "t16_sub_reg", 0b00011010000, 0b11111110000, 11);
+    arm_proc_set<&CPU::t16_sub_sp7>(false, 0, "t16_sub_sp7", 0b10110000100, 0b11111111100, 11);
+    arm_proc_set<&CPU::t16_svc>(false, 0, "t16_svc", 0b11011111100, 0b11111111000, 11);
+    arm_proc_set<&CPU::t16_tst_rdn3>(false, 0, "t16_tst_rdn3", 0b01000010000, 0b11111111110, 11);
+}
+// Swap the generic handlers of the hot families for instances with the slot's decode bits baked in
+void CPU::arm_proc_spec()
+{
+    static const arm_proc_t dp_imm[16]   = {&CPU::arm_and_imm, &CPU::arm_eor_imm, &CPU::arm_sub_imm,
+                                            &CPU::arm_rsb_imm, &CPU::arm_add_imm, &CPU::arm_adc_imm,
+                                            &CPU::arm_sbc_imm, &CPU::arm_rsc_imm, &CPU::arm_tst_imm,
+                                            &CPU::arm_teq_imm, &CPU::arm_cmp_imm, &CPU::arm_cmn_imm,
+                                            &CPU::arm_orr_imm, &CPU::arm_mov_imm12, &CPU::arm_bic_imm,
+                                            &CPU::arm_mvn_imm};
+    static const arm_proc_t dp_regi[16]  = {&CPU::arm_and_regi, &CPU::arm_eor_regi,  &CPU::arm_sub_regi,
+                                            &CPU::arm_rsb_regi, &CPU::arm_add_regi,  &CPU::arm_adc_regi,
+                                            &CPU::arm_sbc_regi, &CPU::arm_rsc_regi,  &CPU::arm_tst_regi,
+                                            &CPU::arm_teq_regi, &CPU::arm_cmp_regi,  &CPU::arm_cmn_regi,
+                                            &CPU::arm_orr_regi, &CPU::arm_shift_imm, &CPU::arm_bic_regi,
+                                            &CPU::arm_mvn_regi};
+    static const arm_proc_t memio_imm[4] = {&CPU::arm_str_imm, &CPU::arm_ldr_imm, &CPU::arm_strb_imm,
+                                            &CPU::arm_ldrb_imm};
+    static const arm_proc_t memio_reg[4] = {&CPU::arm_str_reg, &CPU::arm_ldr_reg, &CPU::arm_strb_reg,
+                                            &CPU::arm_ldrb_reg};
+
+    static const arm_proc_t alu_imm8[4]   = {&CPU::t16_mov_imm, &CPU::t16_cmp_imm8, &CPU::t16_add_imm8,
+                                             &CPU::t16_sub_imm8};
+    static const arm_proc_t shift_imm5[3] = {&CPU::t16_lsl_imm5, &CPU::t16_lsr_imm5, &CPU::t16_asr_imm5};
+    static const arm_proc_t memio_imm5[6] = {&CPU::t16_str_imm5,  &CPU::t16_ldr_imm5,  &CPU::t16_strb_imm5,
+                                             &CPU::t16_ldrb_imm5, &CPU::t16_strh_imm5, &CPU::t16_ldrh_imm5};
+
+    static const arm_proc_t dp_imm_spec[32]      = {SPEC_32(SPEC_PROC, arm_dp_imm, 0, false)};
+    static const arm_proc_t dp_regi_spec[128]    = {SPEC_128(SPEC_PROC, arm_dp_regi, 0, false)};
+    static const arm_proc_t memio_imm_spec[32]   = {SPEC_32(SPEC_PROC, arm_memio_imm, 0, false)};
+    static const arm_proc_t memio_reg_spec[128]  = {SPEC_128(SPEC_PROC, arm_memio_reg, 0, false)};
+    static const arm_proc_t alu_imm8_spec[32]    = {SPEC_32(SPEC_PROC, t16_alu_imm8, 0, false)};
+    static const arm_proc_t shift_imm5_spec[96]  = {SPEC_64(SPEC_PROC, t16_shift_imm5, 0, false),
+                                                    SPEC_32(SPEC_PROC, t16_shift_imm5, 64, false)};
+    static const arm_proc_t memio_imm5_spec[192] = {SPEC_128(SPEC_PROC, t16_memio_imm5, 0, false),
+                                                    SPEC_64(SPEC_PROC, t16_memio_imm5, 128, false)};
+
+    uint32_t i;
+    for (i = 0; i < 4096; i++) {
+        arm_proc_t proc = arm_proc[0][i];
+        uint8_t    opc  = (i >> 5) & 0xf;
+        uint8_t    bl   = ((i >> 5) & 2) | ((i >> 4) & 1);
+        if (proc == dp_imm[opc])
+            arm_proc[0][i] = dp_imm_spec[(i >> 4) & 0x1f];
+        else if (proc == dp_regi[opc])
+            arm_proc[0][i] = dp_regi_spec[((i >> 2) & 0x7c) | ((i >> 1) & 3)];
+        else if (proc == memio_imm[bl])
+            arm_proc[0][i] = memio_imm_spec[(i >> 4) & 0x1f];
+        else if (proc == memio_reg[bl])
+            arm_proc[0][i] = memio_reg_spec[((i >> 2) & 0x7c) | ((i >> 1) & 3)];
+    }
+    for (i = 0; i < 2048; i++) {
+        arm_proc_t proc = thumb_proc[i];
+        uint8_t    kind = (i >> 6) & 3;
+        uint8_t    mem  = (i >> 6) - 0xc;
+        if (proc == alu_imm8[kind])
+            thumb_proc[i] = alu_imm8_spec[(i >> 3) & 0x1f];
+        else if (kind < 3 && proc == shift_imm5[kind])
+            thumb_proc[i] = shift_imm5_spec[(kind << 5) | ((i >> 1) & 0x1f)];
+        else if (mem < 6 && proc == memio_imm5[mem])
+            thumb_proc[i] = memio_imm5_spec[(mem << 5) | ((i >> 1) & 0x1f)];
+    }
 }
 void CPU::arm_init()
 {
-    gba->bios        = (uint8_t *)malloc(0x4000);
-    gba->mem->wram   = (uint8_t *)malloc(0x40000);
-    gba->mem->iwram  = (uint8_t *)malloc(0x8000);
-    gba->mem->pram   = (uint8_t *)malloc(0x400);
-    gba->mem->vram   = (uint8_t *)malloc(0x18000);
-    gba->mem->oam    = (uint8_t *)malloc(0x400);
-    gba->rom         = (uint8_t *)malloc(0x2000000);
-    gba->mem->eeprom = (uint8_t *)malloc(0x2000);
-    gba->mem->sram   = (uint8_t *)malloc(0x10000);
-    gba->mem->flash  = (uint8_t *)malloc(0x20000);
+    gba->bios        = (uint8_t *)malloc(BIOS_SZ);
+    gba->mem->wram   = (uint8_t *)malloc(WRAM_SZ);
+    gba->mem->iwram  = (uint8_t *)malloc(IWRAM_SZ);
+    gba->mem->pram   = (uint8_t *)malloc(PRAM_SZ);
+    gba->mem->vram   = (uint8_t *)malloc(VRAM_SZ);
+    gba->mem->oam    = (uint8_t *)malloc(OAM_SZ);
+    gba->rom         = (uint8_t *)calloc(1, ROM_SZ);    // Padding up to the mirror size reads as zero
+    gba->mem->eeprom = (uint8_t *)malloc(EEPROM_SZ);
+    gba->mem->sram   = (uint8_t *)malloc(SRAM_SZ);
+    gba->mem->flash  = (uint8_t *)malloc(FLASH_SZ);
+    arm_blk          = (arm_blk_t *)malloc(sizeof(arm_blk_t) * BLK_LINES);
+    arm_blk_flush();
+    // Reused heap would otherwise leak an earlier instance's RAM and registers into this one
+    gba->state_sync(nullptr, false);
+#ifdef GBA_PROFILE
+    memset(prof_arm, 0, sizeof(prof_arm));
+    memset(prof_t16, 0, sizeof(prof_t16));
+    memset(prof_arm_name, 0, sizeof(prof_arm_name));
+    memset(prof_t16_name, 0, sizeof(prof_t16_name));
+    prof_pc.clear();
+    prof_idle      = 0;
+    prof_idle_pend = 0;
+#endif
     arm_proc_init();
     thumb_proc_init();
+    arm_idle_init();
+    arm_proc_spec();
     gba->io->key_input.w = 0x3ff;
     gba->io->wait_cnt.w  = 0;
     arm_cycles           = 0;
+    arm_target           = 0;
     gba->io->update_ws();
 }
 void CPU::arm_uninit()
 {
+#ifdef GBA_PROFILE
+    arm_prof_report();
+#endif
     free(gba->bios);
     free(gba->mem->wram);
     free(gba->mem->iwram);
@@ -2624,6 +3066,7 @@ void CPU::arm_uninit()
     free(gba->mem->eeprom);
     free(gba->mem->sram);
     free(gba->mem->flash);
+    free(arm_blk);
 }
 void CPU::t16_inc_r15()
 {
@@ -2658,30 +3101,452 @@ void CPU::arm_step()
         CALL_MEMBER_FN(*this, arm_proc[0][proc])();
     arm_inc_r15();
 }
-void CPU::arm_exec(uint32_t target_cycles)
+bool CPU::arm_blk_cacheable(uint32_t address)
+{
+    // Stores into WRAM and IWRAM drop the blocks decoded from the lines they hit
+    switch (address >> 24) {
+        case 0x0:
+        case 0x2:
+        case 0x3:
+        case 0x8:
+        case 0x9:
+        case 0xa:
+        case 0xb:
+        case 0xc:
+        case 0xd:
+            return true;
+    }
+    return false;
+}
+bool CPU::arm_blk_is_end(arm_proc_t proc, uint8_t cond)
+{
+    if (proc == &CPU::t16_b_imm11 || proc == &CPU::t16_bx || proc == &CPU::t16_blx || proc == &CPU::t16_blx_h1 ||
+        proc == &CPU::t16_blx_h3 || proc == &CPU::t16_svc || proc == &CPU::arm_blx_imm || proc == &CPU::arm_und)
+        return true;
+    if (cond != ARM_COND_ALWAYS)
+        return false;
+    return proc == &CPU::arm_b || proc == &CPU::arm_bl || proc == &CPU::arm_bx || proc == &CPU::arm_blx_reg ||
+           proc == &CPU::arm_svc;
+}
+// Swaps a specialized handler for its twin that takes the operand fields decoded here
+void CPU::arm_blk_decode(arm_blk_inst_t *inst, uint32_t idx, bool thumb)
+{
+    static const arm_proc_t dp_imm_spec[32]      = {SPEC_32(SPEC_PROC, arm_dp_imm, 0, false)};
+    static const arm_proc_t dp_imm_dec[32]       = {SPEC_32(SPEC_PROC, arm_dp_imm, 0, true)};
+    static const arm_proc_t dp_regi_spec[128]    = {SPEC_128(SPEC_PROC, arm_dp_regi, 0, false)};
+    static const arm_proc_t dp_regi_dec[128]     = {SPEC_128(SPEC_PROC, arm_dp_regi, 0, true)};
+    static const arm_proc_t memio_imm_spec[32]   = {SPEC_32(SPEC_PROC, arm_memio_imm, 0, false)};
+    static const arm_proc_t memio_imm_dec[32]    = {SPEC_32(SPEC_PROC, arm_memio_imm, 0, true)};
+    static const arm_proc_t memio_reg_spec[128]  = {SPEC_128(SPEC_PROC, arm_memio_reg, 0, false)};
+    static const arm_proc_t memio_reg_dec[128]   = {SPEC_128(SPEC_PROC, arm_memio_reg, 0, true)};
+    static const arm_proc_t alu_imm8_spec[32]    = {SPEC_32(SPEC_PROC, t16_alu_imm8, 0, false)};
+    static const arm_proc_t alu_imm8_dec[32]     = {SPEC_32(SPEC_PROC, t16_alu_imm8, 0, true)};
+    static const arm_proc_t shift_imm5_spec[96]  = {SPEC_64(SPEC_PROC, t16_shift_imm5, 0, false),
+                                                    SPEC_32(SPEC_PROC, t16_shift_imm5, 64, false)};
+    static const arm_proc_t shift_imm5_dec[96]   = {SPEC_64(SPEC_PROC, t16_shift_imm5, 0, true),
+                                                    SPEC_32(SPEC_PROC, t16_shift_imm5, 64, true)};
+    static const arm_proc_t memio_imm5_spec[192] = {SPEC_128(SPEC_PROC, t16_memio_imm5, 0, false),
+                                                    SPEC_64(SPEC_PROC, t16_memio_imm5, 128, false)};
+    static const arm_proc_t memio_imm5_dec[192]  = {SPEC_128(SPEC_PROC, t16_memio_imm5, 0, true),
+                                                    SPEC_64(SPEC_PROC, t16_memio_imm5, 128, true)};
+#ifdef GBA_THREADED
+    static const arm_thread_t dp_imm_thread[32]      = {SPEC_32(SPEC_ARM_THREAD, arm_dp_imm, 0, true)};
+    static const arm_thread_t dp_regi_thread[128]    = {SPEC_128(SPEC_ARM_THREAD, arm_dp_regi, 0, true)};
+    static const arm_thread_t memio_imm_thread[32]   = {SPEC_32(SPEC_ARM_THREAD, arm_memio_imm, 0, true)};
+    static const arm_thread_t memio_reg_thread[128]  = {SPEC_128(SPEC_ARM_THREAD, arm_memio_reg, 0, true)};
+    static const arm_thread_t alu_imm8_thread[32]    = {SPEC_32(SPEC_T16_THREAD, t16_alu_imm8, 0, true)};
+    static const arm_thread_t shift_imm5_thread[96]  = {SPEC_64(SPEC_T16_THREAD, t16_shift_imm5, 0, true),
+                                                        SPEC_32(SPEC_T16_THREAD, t16_shift_imm5, 64, true)};
+    static const arm_thread_t memio_imm5_thread[192] = {SPEC_128(SPEC_T16_THREAD, t16_memio_imm5, 0, true),
+                                                        SPEC_64(SPEC_T16_THREAD, t16_memio_imm5, 128, true)};
+#define BLK_DECODED(tbl, v) (inst->proc = tbl##_dec[v], inst->thread = tbl##_thread[v])
+#else
+#define BLK_DECODED(tbl, v) inst->proc = tbl##_dec[v]
+#endif
+
+    uint32_t op = inst->op;
+    if (thumb) {
+        uint8_t  kind  = (idx >> 6) & 3;
+        uint8_t  mem   = (idx >> 6) - 0xc;
+        uint32_t v_alu = (idx >> 3) & 0x1f;
+        uint32_t v_imm = (idx >> 1) & 0x1f;
+        inst->rd       = (op >> 0) & 0x7;
+        inst->rn       = (op >> 3) & 0x7;
+        if (inst->proc == alu_imm8_spec[v_alu]) {
+            BLK_DECODED(alu_imm8, v_alu);
+            inst->imm = (op >> 0) & 0xff;
+        } else if (kind < 3 && inst->proc == shift_imm5_spec[(kind << 5) | v_imm]) {
+            BLK_DECODED(shift_imm5, (kind << 5) | v_imm);
+        } else if (mem < 6 && inst->proc == memio_imm5_spec[(mem << 5) | v_imm]) {
+            BLK_DECODED(memio_imm5, (mem << 5) | v_imm);
+        }
+    } else {
+        uint32_t v_imm = (idx >> 4) & 0x1f;
+        uint32_t v_reg = ((idx >> 2) & 0x7c) | ((idx >> 1) & 3);
+        inst->rm       = (op >> 0) & 0xf;
+        inst->rd       = (op >> 12) & 0xf;
+        inst->rn       = (op >> 16) & 0xf;
+        if (inst->proc == dp_imm_spec[v_imm]) {
+            BLK_DECODED(dp_imm, v_imm);
+            inst->imm = ROR((op >> 0) & 0xff, (op >> 7) & 0x1e);
+        } else if (inst->proc == memio_imm_spec[v_imm]) {
+            BLK_DECODED(memio_imm, v_imm);
+            inst->imm = (op >> 0) & 0xfff;
+        } else if (inst->proc == dp_regi_spec[v_reg]) {
+            BLK_DECODED(dp_regi, v_reg);
+            inst->imm = (op >> 7) & 0x1f;
+        } else if (inst->proc == memio_reg_spec[v_reg]) {
+            BLK_DECODED(memio_reg, v_reg);
+            inst->imm = (op >> 7) & 0x1f;
+        }
+    }
+#undef BLK_DECODED
+}
+void CPU::arm_blk_build(arm_blk_t *blk, uint32_t address, bool thumb)
+{
+    uint8_t *base;
+    uint32_t mask;
+    uint32_t end = ((address >> 24) + 1) << 24;
+    switch (address >> 24) {
+        case 0x0:
+            base = gba->bios;
+            mask = 0x3fff;
+            break;
+        case 0x2:
+            base = gba->mem->wram;
+            mask = 0x3ffff;
+            break;
+        case 0x3:
+            base = gba->mem->iwram;
+            mask = 0x7fff;
+            break;
+        default:
+            base = gba->rom;
+            mask = 0x1ffffff;
+            break;
+    }
+    blk->tag  = address | thumb;
+    blk->len  = 0;
+    blk->line = gba->mem->code_line_idx(address);
+    if (blk->line != CODE_LINE_NONE) {
+        // RAM blocks stay inside one code line so a store only has to drop that line
+        end                            = (address | ((1 << CODE_LINE_SHIFT) - 1)) + 1;
+        blk->gen                       = gba->mem->code_gen[blk->line];
+        gba->mem->code_line[blk->line] = 1;
+    }
+    while (blk->len < BLK_MAX_INSTS && address < end) {
+        arm_blk_inst_t *inst = &blk->inst[blk->len++];
+        if (thumb) {
+            inst->op   = *(uint16_t *)(base + (address & mask));
+            inst->proc = thumb_proc[inst->op >> 5];
+            inst->cond = ARM_COND_ALWAYS;
+#ifdef GBA_THREADED
+            inst->thread = t16_thread[inst->op >> 5];
+#endif
+            arm_blk_decode(inst, inst->op >> 5, true);
+            address += 2;
+        } else {
+            uint32_t proc;
+            inst->op = *(uint32_t *)(base + (address & mask));
+            proc     = (inst->op >> 16) & 0xff0;
+            proc |= (inst->op >> 4) & 0x00f;
+            inst->cond = inst->op >> 28;
+            if (inst->cond == ARM_COND_UNCOND) {
+                inst->proc = arm_proc[1][proc];
+                inst->cond = ARM_COND_ALWAYS;
+#ifdef GBA_THREADED
+                inst->thread = arm_thread[1][proc];
+#endif
+            } else {
+                inst->proc = arm_proc[0][proc];
+#ifdef GBA_THREADED
+                inst->thread = arm_thread[0][proc];
+#endif
+                arm_blk_decode(inst, proc, false);
+            }
+            address += 4;
+        }
+        if (arm_blk_is_end(inst->proc, inst->cond))
+            break;
+    }
+#ifdef GBA_THREADED
+    blk->inst[blk->len].thread = &CPU::arm_thread_end;
+#endif
+}
+CPU::arm_blk_t *CPU::arm_blk_get(uint32_t address, bool thumb)
+{
+    arm_blk_t *blk = &arm_blk[((address >> 1) ^ (address >> 12)) & (BLK_LINES - 1)];
+    if (blk->tag != (address | thumb) || (blk->line != CODE_LINE_NONE && blk->gen != gba->mem->code_gen[blk->line]))
+        arm_blk_build(blk, address, thumb);
+    return blk;
+}
+void CPU::arm_blk_pre(bool thumb)
+{
+    arm_op      = arm_pipe[0];
+    arm_pipe[0] = arm_pipe[1];
+    if (thumb)
+        arm_pipe[1] = arm_fetchh(SEQUENTIAL);
+    else
+        arm_pipe[1] = arm_fetch(SEQUENTIAL);
+}
+bool CPU::arm_blk_post(bool thumb)
+{
+    bool branch = pipe_reload;
+    arm_insts++;
+    if (thumb)
+        t16_inc_r15();
+    else
+        arm_inc_r15();
+    if (int_halt && arm_cycles < arm_target)
+        arm_cycles = arm_target;
+    // Leave on any control flow change, the next block is looked up by the new PC
+    return branch || pipe_reload || arm_cycles >= arm_target || t_exit;
+}
+void CPU::arm_blk_run(arm_blk_t *blk)
 {
-    if (int_halt) {
-        gba->timer->timers_clock(target_cycles);
+    bool    thumb = blk->tag & 1;
+    uint8_t i;
+    for (i = 0; i < blk->len; i++) {
+        arm_blk_inst_t *inst = &blk->inst[i];
+        TRACE_ADD(thumb);
+        PROF_BEGIN(thumb);
+        arm_blk_pre(thumb);
+        arm_dec = inst;
+        if (inst->cond == ARM_COND_ALWAYS || arm_cond(inst->cond))
+            CALL_MEMBER_FN(*this, inst->proc)();
+        PROF_END(thumb);
+        if (arm_blk_post(thumb))
+            break;
+    }
+}
+#ifdef GBA_THREADED
+#ifdef __clang__
+#define THREAD_TAIL [[clang::musttail]]
+#else
+#define THREAD_TAIL    // GCC turns the call into a jump from -O2 on, unoptimized builds nest one frame per entry
+#endif
+
+// The body of arm_blk_run for one entry, with the handler known at compile time
+template <CPU::arm_proc_t proc, bool thumb>
+bool CPU::arm_thread_step(const arm_blk_inst_t *inst)
+{
+    TRACE_ADD(thumb);
+    PROF_BEGIN(thumb);
+    arm_blk_pre(thumb);
+    arm_dec = inst;
+    if (thumb || inst->cond == ARM_COND_ALWAYS || arm_cond(inst->cond))
+        (this->*proc)();
+    PROF_END(thumb);
+    return arm_blk_post(thumb);
+}
+// One copy per handler, so each ends in its own indirect jump to the next entry
+template <CPU::arm_proc_t proc, bool thumb>
+void CPU::arm_thread_op(CPU *cpu, const arm_blk_inst_t *inst)
+{
+    if (cpu->arm_thread_step<proc, thumb>(inst))
+        return;
+    THREAD_TAIL return inst[1].thread(cpu, inst + 1);
+}
+void CPU::arm_thread_end(CPU *cpu, const arm_blk_inst_t *inst)
+{
+}
+#endif
+void CPU::arm_blk_flush()
+{
+    uint32_t i;
+    for (i = 0; i < BLK_LINES; i++) {
+        arm_blk[i].tag = BLK_TAG_NONE;
+    }
+    gba->mem->code_clear();
+}
+void CPU::arm_idle_init()
+{
+    // Instructions that only read memory and registers, the loop branch itself is not scanned
+    static const arm_proc_t arm_pure[] = {
+        &CPU::arm_and_imm,   &CPU::arm_and_regi,  &CPU::arm_and_regr,  &CPU::arm_eor_imm,   &CPU::arm_eor_regi,
+        &CPU::arm_eor_regr,  &CPU::arm_sub_imm,   &CPU::arm_sub_regi,  &CPU::arm_sub_regr,  &CPU::arm_rsb_imm,
+        &CPU::arm_rsb_regi,  &CPU::arm_rsb_regr,  &CPU::arm_add_imm,   &CPU::arm_add_regi,  &CPU::arm_add_regr,
+        &CPU::arm_adc_imm,   &CPU::arm_adc_regi,  &CPU::arm_adc_regr,  &CPU::arm_sbc_imm,   &CPU::arm_sbc_regi,
+        &CPU::arm_sbc_regr,  &CPU::arm_rsc_imm,   &CPU::arm_rsc_regi,  &CPU::arm_rsc_regr,  &CPU::arm_tst_imm,
+        &CPU::arm_tst_regi,  &CPU::arm_tst_regr,  &CPU::arm_teq_imm,   &CPU::arm_teq_regi,  &CPU::arm_teq_regr,
+        &CPU::arm_cmp_imm,   &CPU::arm_cmp_regi,  &CPU::arm_cmp_regr,  &CPU::arm_cmn_imm,   &CPU::arm_cmn_regi,
+        &CPU::arm_cmn_regr,  &CPU::arm_orr_imm,   &CPU::arm_orr_regi,  &CPU::arm_orr_regr,  &CPU::arm_bic_imm,
+        &CPU::arm_bic_regi,  &CPU::arm_bic_regr,  &CPU::arm_mvn_imm,   &CPU::arm_mvn_regi,  &CPU::arm_mvn_regr,
+        &CPU::arm_mov_imm12, &CPU::arm_shift_imm, &CPU::arm_shift_reg, &CPU::arm_mrs,       &CPU::arm_ldr_imm,
+        &CPU::arm_ldr_reg,   &CPU::arm_ldrb_imm,  &CPU::arm_ldrb_reg,  &CPU::arm_ldrh_imm,  &CPU::arm_ldrh_reg,
+        &CPU::arm_ldrsb_imm, &CPU::arm_ldrsb_reg, &CPU::arm_ldrsh_imm, &CPU::arm_ldrsh_reg,
+    };
+    static const arm_proc_t t16_pure[] = {
+        &CPU::t16_adc_rdn3,  &CPU::t16_add_imm3,  &CPU::t16_add_imm8,  &CPU::t16_add_reg,   &CPU::t16_add_rdn4,
+        &CPU::t16_add_sp7,   &CPU::t16_add_sp8,   &CPU::t16_adr,       &CPU::t16_and_rdn3,  &CPU::t16_asr_imm5,
+        &CPU::t16_asr_rdn3,  &CPU::t16_bic_rdn3,  &CPU::t16_cmn_rdn3,  &CPU::t16_cmp_imm8,  &CPU::t16_cmp_rdn3,
+        &CPU::t16_cmp_rdn4,  &CPU::t16_eor_rdn3,  &CPU::t16_ldr_imm5,  &CPU::t16_ldr_sp8,   &CPU::t16_ldr_pc8,
+        &CPU::t16_ldr_reg,   &CPU::t16_ldrb_imm5, &CPU::t16_ldrb_reg,  &CPU::t16_ldrh_imm5, &CPU::t16_ldrh_reg,
+        &CPU::t16_ldrsb_reg, &CPU::t16_ldrsh_reg, &CPU::t16_lsl_imm5,  &CPU::t16_lsl_rdn3,  &CPU::t16_lsr_imm5,
+        &CPU::t16_lsr_rdn3,  &CPU::t16_mov_imm,   &CPU::t16_mov_rd4,   &CPU::t16_mov_rd3,   &CPU::t16_mul,
+        &CPU::t16_mvn_rdn3,  &CPU::t16_orr_rdn3,  &CPU::t16_ror,       &CPU::t16_rsb_rdn3,  &CPU::t16_sbc_rdn3,
+        &CPU::t16_sub_imm3,  &CPU::t16_sub_imm8,  &CPU::t16_sub_reg,   &CPU::t16_sub_sp7,   &CPU::t16_tst_rdn3,
+    };
+    uint32_t i, j;
+    // Looked up by slot, the handlers get swapped for template instances afterwards
+    for (i = 0; i < 4096; i++) {
+        idle_arm_pure[i] = false;
+        for (j = 0; j < sizeof(arm_pure) / sizeof(arm_pure[0]); j++) {
+            if (arm_proc[0][i] == arm_pure[j])
+                idle_arm_pure[i] = true;
+        }
+    }
+    for (i = 0; i < 2048; i++) {
+        idle_t16_pure[i] = false;
+        for (j = 0; j < sizeof(t16_pure) / sizeof(t16_pure[0]); j++) {
+            if (thumb_proc[i] == t16_pure[j])
+                idle_t16_pure[i] = true;
+        }
+    }
+}
+bool CPU::arm_idle_pure(uint32_t op, bool thumb)
+{
+    if (thumb) {
+        arm_proc_t proc = thumb_proc[op >> 5];
+        // High register forms can write the PC
+        if ((proc == &CPU::t16_add_rdn4 || proc == &CPU::t16_mov_rd4) && ((op & 7) | ((op >> 4) & 8)) == 15)
+            return false;
+        return idle_t16_pure[op >> 5];
+    }
+    if ((op >> 28) == ARM_COND_UNCOND || ((op >> 12) & 0xf) == 15)
+        return false;
+    return idle_arm_pure[((op >> 16) & 0xff0) | ((op >> 4) & 0x00f)];
+}
+bool CPU::arm_idle_scan(uint32_t head, uint32_t tail, bool thumb)
+{
+    uint32_t address;
+    for (address = head; address < tail; address += thumb ? 2 : 4) {
+        uint8_t *ptr = gba->mem->page_read_ptr(address);
+        if (!ptr || !arm_idle_pure(thumb ? *(uint16_t *)ptr : *(uint32_t *)ptr, thumb))
+            return false;
+    }
+    return true;
+}
+bool CPU::arm_idle_known(uint32_t head, uint32_t tail)
+{
+    uint8_t i;
+    for (i = 0; i < idle_cnt; i++) {
+        if (idle_list[i].head == head && idle_list[i].tail == tail)
+            return true;
+    }
+    return false;
+}
+void CPU::arm_idle_check(uint32_t head, uint32_t tail)
+{
+    bool thumb = arm_in_thumb();
+    if (tail - head > (IDLE_MAX_INSTS - 1) * (thumb ? 2 : 4))
+        return;
+    if (head != idle_head || tail != idle_tail) {
+        // Only ROM loops are remembered, code in RAM can be replaced. Another branch back to the same head covers
+        // different instructions, so it gets its own scan.
+        idle_head = head;
+        idle_tail = tail;
+        idle_snap = false;
+        idle_pure = ((head >> 27) && arm_idle_known(head, tail)) || arm_idle_scan(head, tail, thumb);
+        return;
+    }
+    if (!idle_pure)
         return;
+    arm_flags_sync();
+    // A pure loop that ends an iteration with the same state as the last one can only be released by an event.
+    // Whole iterations are skipped and the last ones run normally, so the slice ends on the same instruction.
+    if (idle_snap && !memcmp(idle_regs, arm_r.r, 15 * sizeof(uint32_t)) && idle_regs[15] == arm_r.cpsr) {
+        uint32_t len  = arm_cycles - idle_cycles;
+        uint32_t skip = arm_cycles < arm_target ? (arm_target - arm_cycles) / len : 0;
+        if ((head >> 27) && !arm_idle_known(head, tail) && idle_cnt < IDLE_LIST_SZ)
+            idle_list[idle_cnt++] = {head, tail};
+        if (skip > 1) {
+            arm_cycles += (skip - 1) * len;
+            PROF_IDLE((skip - 1) * len);
+        }
+        idle_cycles = arm_cycles;
+        return;
+    }
+    memcpy(idle_regs, arm_r.r, 15 * sizeof(uint32_t));
+    idle_regs[15] = arm_r.cpsr;
+    idle_cycles   = arm_cycles;
+    idle_snap     = true;
+}
+void CPU::arm_idle_clear()
+{
+    idle_head = IDLE_NONE;
+    idle_tail = IDLE_NONE;
+    idle_cnt  = 0;
+}
+bool CPU::arm_blk_exec(uint32_t pc, bool thumb)
+{
+    arm_blk_t *blk = arm_blk_get(pc, thumb);
+    // Words fetched into the pipeline before a store to RAM code still run, the interpreter takes them
+    if (blk->line != CODE_LINE_NONE &&
+        (arm_pipe[0] != blk->inst[0].op || (blk->len > 1 && arm_pipe[1] != blk->inst[1].op)))
+        return false;
+#ifdef GBA_THREADED
+    if (thread_enb) {
+        blk->inst[0].thread(this, blk->inst);
+        return true;
+    }
+#endif
+    arm_blk_run(blk);
+    return true;
+}
+// The mode loops only leave when the slice is spent or T was written
+void CPU::arm_run()
+{
+    while (arm_cycles < arm_target && !t_exit) {
+        if (arm_blk_cacheable(arm_r.r[15] - 8) && arm_blk_exec(arm_r.r[15] - 8, false))
+            continue;
+        TRACE_ADD(false);
+        arm_op      = arm_pipe[0];
+        arm_pipe[0] = arm_pipe[1];
+        arm_insts++;
+        PROF_BEGIN(false);
+        arm_step();
+        PROF_END(false);
+        if (int_halt && arm_cycles < arm_target)
+            arm_cycles = arm_target;
+    }
+}
+void CPU::t16_run()
+{
+    while (arm_cycles < arm_target && !t_exit) {
+        if (arm_blk_cacheable(arm_r.r[15] - 4) && arm_blk_exec(arm_r.r[15] - 4, true))
+            continue;
+        TRACE_ADD(true);
+        arm_op      = arm_pipe[0];
+        arm_pipe[0] = arm_pipe[1];
+        arm_insts++;
+        PROF_BEGIN(true);
+        t16_step();
+        PROF_END(true);
+        if (int_halt && arm_cycles < arm_target)
+            arm_cycles = arm_target;
     }
-    while (arm_cycles < target_cycles) {
-        uint32_t cycles = arm_cycles;
-        arm_op          = arm_pipe[0];
-        arm_pipe[0]     = arm_pipe[1];
+}
+void CPU::arm_exec(uint32_t target_cycles)
+{
+    arm_target = target_cycles;
+    idle_snap  = false;
+    if (int_halt)
+        return;
+    while (arm_cycles < arm_target) {
+        t_exit = false;
         if (arm_in_thumb())
-            t16_step();
+            t16_run();
         else
-            arm_step();
-        if (int_halt)
-            arm_cycles = target_cycles;
-        if (gba->timer->tmr_enb)
-            gba->timer->timers_clock(arm_cycles - cycles);
+            arm_run();
     }
-    arm_cycles -= target_cycles;
+    arm_cycles -= arm_target;
 }
 void CPU::arm_int(uint32_t address, int8_t mode)
 {
+    arm_flags_sync();
     uint32_t cpsr = arm_r.cpsr;
+    idle_snap     = false;
     arm_mode_set(mode);
     arm_spsr_set(cpsr);
 
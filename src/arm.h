@@ -5,6 +5,9 @@
 #include <stdbool.h>
 #include "mem.h"
 #include "gba.h"
+#ifdef GBA_PROFILE
+#include <unordered_map>
+#endif
 
 #define ROR(val, s) (((val) >> (s)) | ((val) << (32 - (s))))
 #define SBIT(op)    ((op & (1 << 20)) ? true : false)
@@ -25,6 +28,8 @@
 #define ARM_F (1 << 6)     // FIQ off
 #define ARM_T (1 << 5)     // Thumb
 
+#define ARM_NZCV (ARM_N | ARM_Z | ARM_C | ARM_V)
+
 // Modes
 #define ARM_USR 0b10000    // User
 #define ARM_FIQ 0b10001    // Fast IRQ
@@ -35,6 +40,16 @@
 #define ARM_UND 0b11011    // Undefined
 #define ARM_SYS 0b11111    // System
 
+// Register banks, System shares the User one
+#define BANK_USR   0
+#define BANK_FIQ   1
+#define BANK_IRQ   2
+#define BANK_SVC   3
+#define BANK_ABT   4
+#define BANK_UND   5
+#define BANK_MON   6
+#define BANK_COUNT 7
+
 // Interrupt addresses
 #define ARM_VEC_RESET  0x00    // Reset
 #define ARM_VEC_UND    0x04    // Undefined
@@ -45,6 +60,21 @@
 #define ARM_VEC_IRQ    0x18    // IRQ
 #define ARM_VEC_FIQ    0x1c    // Fast IRQ
 
+#define ARM_COND_ALWAYS 0b1110
+
+// Block cache
+#define BLK_LINES     1024
+#define BLK_MAX_INSTS 32
+#define BLK_TAG_NONE  0xffffffff
+
+// Idle loop detection
+#define IDLE_MAX_INSTS 8     // Longest loop body, branch included
+#define IDLE_LIST_SZ   64    // Confirmed idle loops kept per ROM
+#define IDLE_NONE      0xffffffff
+
+// Fetch region cache
+#define FETCH_NONE 0xffffffff
+
 
 typedef enum
 {
@@ -57,6 +87,15 @@ typedef enum
     SHIFT
 } arm_logic_e;
 
+// Operation that produced the pending NZCV
+typedef enum
+{
+    FLAGS_SYNCED,
+    FLAGS_ADD,
+    FLAGS_SUB,
+    FLAGS_LOGIC
+} arm_flags_e;
+
 typedef enum
 {
     BYTE  = 1,
@@ -137,45 +176,12 @@ typedef struct
 {
     uint32_t r[16];
 
-    uint32_t r8_usr;
-    uint32_t r9_usr;
-    uint32_t r10_usr;
-    uint32_t r11_usr;
-    uint32_t r12_usr;
-    uint32_t r13_usr;
-    uint32_t r14_usr;
-
-    uint32_t r8_fiq;
-    uint32_t r9_fiq;
-    uint32_t r10_fiq;
-    uint32_t r11_fiq;
-    uint32_t r12_fiq;
-    uint32_t r13_fiq;
-    uint32_t r14_fiq;
-
-    uint32_t r13_irq;
-    uint32_t r14_irq;
-
-    uint32_t r13_svc;
-    uint32_t r14_svc;
-
-    uint32_t r13_mon;
-    uint32_t r14_mon;
-
-    uint32_t r13_abt;
-    uint32_t r14_abt;
-
-    uint32_t r13_und;
-    uint32_t r14_und;
+    uint32_t r8_usr[5];    // r8-r12 of every mode but FIQ
+    uint32_t r8_fiq[5];
+    uint32_t r13_bank[BANK_COUNT][2];    // r13 and r14 of each bank
 
     uint32_t cpsr;
-
-    uint32_t spsr_fiq;
-    uint32_t spsr_irq;
-    uint32_t spsr_svc;
-    uint32_t spsr_abt;
-    uint32_t spsr_und;
-    uint32_t spsr_mon;
+    uint32_t spsr[BANK_COUNT];    // The BANK_USR slot is never used
 } arm_regs_t;
 
 class CPU {
@@ -183,31 +189,128 @@ class CPU {
     arm_proc_t arm_proc[2][4096];
     arm_proc_t thumb_proc[2048];
 
+    struct arm_blk_inst_t;
+    typedef void (*arm_thread_t)(CPU *cpu, const arm_blk_inst_t *inst);
+#ifdef GBA_THREADED
+    // Per-handler block trampolines for the arm_proc/thumb_proc slots, arm_blk_decode picks the specialized ones
+    arm_thread_t arm_thread[2][4096];
+    arm_thread_t t16_thread[2048];
+#endif
+
+    // Specialized handlers read their register and immediate fields from here instead of op
+    typedef struct arm_blk_inst_t
+    {
+        arm_proc_t   proc;
+        uint32_t     op;
+        uint8_t      cond;
+        uint8_t      rd;
+        uint8_t      rn;
+        uint8_t      rm;
+        uint32_t     imm;
+        arm_thread_t thread;    // Runs proc then jumps to the next entry's trampoline, unset without GBA_THREADED
+    } arm_blk_inst_t;
+
+    typedef struct
+    {
+        uint32_t       tag;
+        uint8_t        len;
+        uint16_t       line;    // RAM code line the block was decoded from, CODE_LINE_NONE for BIOS and ROM
+        uint32_t       gen;     // Overwrite count of that line at decode time
+        // One entry past the last holds the trampoline that ends the chain
+        arm_blk_inst_t inst[BLK_MAX_INSTS + 1];
+    } arm_blk_t;
+
+    arm_blk_t            *arm_blk = nullptr;
+    const arm_blk_inst_t *arm_dec = nullptr;    // Block cache entry being run
+
+    // A loop is the span from its head up to the backward branch at its tail, both take part in every lookup
+    typedef struct
+    {
+        uint32_t head;
+        uint32_t tail;
+    } arm_idle_loop_t;
+
+    uint32_t        idle_head = IDLE_NONE;
+    uint32_t        idle_tail = IDLE_NONE;
+    bool            idle_pure;
+    bool            idle_snap;
+    uint32_t        idle_regs[16];    // r0-r14 and CPSR at the loop branch
+    uint32_t        idle_cycles;      // arm_cycles at the loop branch
+    arm_idle_loop_t idle_list[IDLE_LIST_SZ];
+    uint8_t         idle_cnt = 0;
+    bool            idle_arm_pure[4096];    // Table slots whose handler is side effect free
+    bool            idle_t16_pure[2048];
+
+    // Host pointer and fetch costs for the 16MB region r15 is in, null base falls back to the bus
+    uint32_t fetch_region = FETCH_NONE;
+    uint8_t *fetch_base;
+    uint32_t fetch_mask;
+    uint8_t  fetch_n_arm;
+    uint8_t  fetch_s_arm;
+    uint8_t  fetch_n_t16;
+    uint8_t  fetch_s_t16;
+
+#ifdef GBA_PROFILE
+    typedef struct
+    {
+        uint64_t insts;
+        uint64_t cycles;
+    } arm_prof_t;
+
+    // Counters indexed like arm_proc/thumb_proc, each slot keeps the name of the handler it was registered with
+    arm_prof_t                             prof_arm[2][4096];
+    arm_prof_t                             prof_t16[2048];
+    const char                            *prof_arm_name[2][4096];
+    const char                            *prof_t16_name[2048];
+    std::unordered_map<uint32_t, uint64_t> prof_pc;           // Hits per guest address, bit 0 set for Thumb
+    uint64_t                               prof_idle;         // Cycles skipped by the idle loop fast-forward
+    uint32_t                               prof_idle_pend;    // Skipped inside the instruction being counted
+#endif
+
   public:
     GBA *gba = nullptr;
 
     uint32_t arm_op;
     uint32_t arm_pipe[2];
     uint32_t arm_cycles;
+    uint32_t arm_target;       // End of the current slice, lowered by the scheduler
+    uint64_t arm_insts = 0;    // Executed guest instructions
 
     bool int_halt;
     bool pipe_reload;
+    bool t_exit;    // T was written or cached code overwritten, the current mode loop has to hand over
+    bool idle_enb = true;
+    bool hle_enb  = false;    // Run the hot BIOS calls natively
+#ifdef GBA_THREADED
+    bool thread_enb = true;    // Run cached blocks through the trampoline chain instead of arm_blk_run
+#endif
 
     arm_regs_t arm_r;
 
+    // Lazy NZCV, the last flag-setting ALU op is kept until something reads CPSR
+    uint8_t  flag_op = FLAGS_SYNCED;
+    uint32_t flag_lhs;    // Carry out for FLAGS_LOGIC
+    uint32_t flag_rhs;
+    uint64_t flag_res;
+
   public:
     CPU(GBA *_gba);
 
+    void     arm_flags_sync();
+    bool     arm_carry();
     bool     arm_flag_tst(uint32_t flag);
     bool     arm_cond(int8_t cond);
     bool     arm_in_thumb();
     uint32_t arm_saturate(int64_t val, int32_t min, int32_t max, bool q);
     uint32_t arm_ssatq(int64_t val);
+    void     arm_fetch_map();
+    void     arm_fetch_clear();
     uint16_t arm_fetchh(access_type_e at);
     uint32_t arm_fetch(access_type_e at);
     uint32_t arm_fetch_n();
     uint32_t arm_fetch_s();
     uint32_t arm_memio_reg_get(uint8_t reg);
+    uint8_t  arm_memio_reg_cnt(uint16_t regs);
 
     arm_data_t    arm_data_imm_op();
     arm_shifter_t arm_data_regi(uint8_t rm, uint8_t type, uint8_t imm);
@@ -215,6 +318,10 @@ class CPU {
     arm_shifter_t arm_data_regr(uint8_t rm, uint8_t type, uint8_t rs);
     arm_data_t    arm_data_regr_op();
 
+    template <bool s, bool d> arm_data_t               arm_data_imm_op();
+    template <uint8_t type, bool c> arm_shifter_t      arm_data_regi(uint8_t rm, uint8_t imm);
+    template <bool s, uint8_t type, bool d> arm_data_t arm_data_regi_op();
+
     arm_data_t t16_data_imm3_op();
     arm_data_t t16_data_imm8_op();
     arm_data_t t16_data_rdn3_op();
@@ -227,7 +334,6 @@ class CPU {
     arm_data_t t16_data_imm5_op(bool rsh);
 
     arm_mpy_t   arm_mpy_op();
-    arm_mpy_t   t16_mpy_op();
     arm_psr_t   arm_mrs_op();
     arm_psr_t   arm_msr_imm_op();
     arm_psr_t   arm_msr_reg_op();
@@ -246,9 +352,11 @@ class CPU {
     arm_memio_t  t16_memio_reg_op();
     arm_parith_t arm_parith_op();
 
+    template <bool p, bool u, bool w, bool d> arm_memio_t               arm_memio_imm_op();
+    template <bool p, bool u, bool w, uint8_t type, bool d> arm_memio_t arm_memio_reg_op();
+
     void arm_flag_set(uint32_t flag, bool cond);
-    void arm_bank_to_regs(int8_t mode);
-    void arm_regs_to_bank(int8_t mode);
+    void arm_bank_swap(int8_t curr, int8_t mode);
     void arm_mode_set(int8_t mode);
     void arm_spsr_get(uint32_t *psr);
     void arm_spsr_set(uint32_t spsr);
@@ -291,9 +399,8 @@ class CPU {
     void arm_logic_teq(arm_data_t op);
     void arm_logic_tst(arm_data_t op);
 
-    void arm_mpy_inc_cycles(uint64_t rhs, bool u);
-    void arm_mpy_add(arm_mpy_t op);
-    void arm_mpy(arm_mpy_t op);
+    void arm_mpy_inc_cycles(uint32_t rhs, bool u);
+    void arm_mpy_32(uint8_t rd, uint32_t lhs, uint32_t rhs, uint32_t acc, bool s);
     void arm_mpy_smla__(arm_mpy_t op, bool m, bool n);
     void arm_mpy_smlal(arm_mpy_t op);
     void arm_mpy_smlal__(arm_mpy_t op, bool m, bool n);
@@ -518,17 +625,65 @@ class CPU {
     void arm_umull();
     void arm_und();
 
-    void arm_proc_fill(bool arm);
-    void arm_proc_set(bool arm, int idx, arm_proc_t proc, uint32_t op, uint32_t mask, int32_t bits);
+    // Handlers with the decode bits of their table slot baked in
+    template <uint8_t opc> void        arm_dp(arm_data_t op);
+    template <uint32_t v, bool d> void arm_dp_imm();
+    template <uint32_t v, bool d> void arm_dp_regi();
+    template <uint32_t v, bool d> void arm_memio_imm();
+    template <uint32_t v, bool d> void arm_memio_reg();
+    template <uint32_t v, bool d> void t16_alu_imm8();
+    template <uint32_t v, bool d> void t16_shift_imm5();
+    template <uint32_t v, bool d> void t16_memio_imm5();
+
+    void                            arm_proc_fill(bool arm);
+    int32_t                         arm_proc_slots(uint32_t op, uint32_t mask, int32_t bits, uint16_t *slots);
+    template <arm_proc_t proc> void arm_proc_set(bool arm, int idx, const char *name, uint32_t op, uint32_t mask,
+                                                 int32_t bits);
+
+#ifdef GBA_PROFILE
+    void arm_prof_name(bool arm, int idx, arm_proc_t proc, const char *name);
+    void arm_prof_add(bool thumb, uint32_t pc, uint32_t cycles);
+    void arm_prof_report();
+#endif
+#ifdef GBA_TRACE
+    void arm_trace_add(bool thumb);
+#endif
 
     void arm_proc_init();
     void thumb_proc_init();
+    void arm_proc_spec();
     void arm_init();
     void arm_uninit();
     void t16_inc_r15();
     void t16_step();
     void arm_inc_r15();
     void arm_step();
+
+    bool       arm_blk_cacheable(uint32_t address);
+    bool       arm_blk_is_end(arm_proc_t proc, uint8_t cond);
+    void       arm_blk_decode(arm_blk_inst_t *inst, uint32_t idx, bool thumb);
+    void       arm_blk_build(arm_blk_t *blk, uint32_t address, bool thumb);
+    arm_blk_t *arm_blk_get(uint32_t address, bool thumb);
+    void       arm_blk_pre(bool thumb);
+    bool       arm_blk_post(bool thumb);
+    void       arm_blk_run(arm_blk_t *blk);
+#ifdef GBA_THREADED
+    template <arm_proc_t proc, bool thumb> bool        arm_thread_step(const arm_blk_inst_t *inst);
+    template <arm_proc_t proc, bool thumb> static void arm_thread_op(CPU *cpu, const arm_blk_inst_t *inst);
+    static void                                        arm_thread_end(CPU *cpu, const arm_blk_inst_t *inst);
+#endif
+    void       arm_blk_flush();
+
+    void arm_idle_init();
+    bool arm_idle_pure(uint32_t op, bool thumb);
+    bool arm_idle_scan(uint32_t head, uint32_t tail, bool thumb);
+    bool arm_idle_known(uint32_t head, uint32_t tail);
+    void arm_idle_check(uint32_t head, uint32_t tail);
+    void arm_idle_clear();
+
+    bool arm_blk_exec(uint32_t pc, bool thumb);
+    void arm_run();
+    void t16_run();
     void arm_exec(uint32_t target_cycles);
     void arm_int(uint32_t address, int8_t mode);
     void arm_check_irq();
@@ -1,26 +1,30 @@
+#include <chrono>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "gba.h"
 #include "arm.h"
 #include "dma.h"
+#include "hle.h"
 #include "mem.h"
 #include "io.h"
+#include "scheduler.h"
 #include "timer.h"
 #include "video.h"
 #include "sound.h"
+#ifdef GBA_TRACE
+#include "trace.h"
+#endif
 #include "../BIOS/bios.h"
 
 #define LINES_TOTAL    228
 #define LINES_VISIBLE  160
 #define CYC_LINE_TOTAL 1232
 #define CYC_LINE_HBLK0 1006
-#define CYC_LINE_HBLK1 (CYC_LINE_TOTAL - CYC_LINE_HBLK0)
 
-GBA *g_gba = nullptr;
 GBA::GBA()
 {
-    g_gba = this;
     cpu   = new CPU(this);
     mem   = new MEM(this);
     dma   = new DMA(this);
@@ -28,6 +32,26 @@ GBA::GBA()
     sound = new SOUND(this);
     timer = new TIMER(this);
     video = new VIDEO(this);
+    sched = new SCHED(this);
+    hle   = new HLE(this);
+#ifdef GBA_TRACE
+    trace = new TRACE();
+#endif
+}
+GBA::~GBA()
+{
+    delete cpu;
+    delete mem;
+    delete dma;
+    delete io;
+    delete sound;
+    delete timer;
+    delete video;
+    delete sched;
+    delete hle;
+#ifdef GBA_TRACE
+    delete trace;
+#endif
 }
 uint32_t GBA::to_pow2(uint32_t val)
 {
@@ -39,35 +63,7 @@ uint32_t GBA::to_pow2(uint32_t val)
     val |= (val >> 16);
     return val + 1;
 }
-void sound_cb(void *data, uint8_t *stream, int32_t len)
-{
-    g_gba->sound->sound_mix(data, stream, len);
-}
-void GBA::sdl_init()
-{
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
-    window             = SDL_CreateWindow("", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 480, 320, 0);
-    renderer           = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    texture            = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGRA8888, SDL_TEXTUREACCESS_STREAMING, 240, 160);
-    tex_pitch          = 240 * 4;
-    SDL_AudioSpec spec = {.freq     = SND_FREQUENCY,    // 32KHz
-                          .format   = AUDIO_S16SYS,     // Signed 16 bits System endiannes
-                          .channels = SND_CHANNELS,     // Stereo
-                          .samples  = SND_SAMPLES,      // 16ms
-                          .callback = sound_cb,
-                          .userdata = NULL};
-    SDL_OpenAudio(&spec, NULL);
-    SDL_PauseAudio(0);
-}
-void GBA::sdl_uninit()
-{
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_CloseAudio();
-    SDL_Quit();
-}
-bool GBA::open_rom(char *romname)
+bool GBA::open_rom(const char *romname)
 {
     FILE *image;
     image = fopen(romname, "rb");
@@ -85,146 +81,174 @@ bool GBA::open_rom(char *romname)
     fseek(image, 0, SEEK_SET);
     fread(rom, cart_rom_size, 1, image);
     fclose(image);
+    mem->page_map_init();
+    cpu->arm_idle_clear();
     return true;
 }
-void GBA::run_frame()
+void GBA::line_start(uint64_t when)
 {
-    io->disp_stat.w &= ~VBLK_FLAG;
-    SDL_LockTexture(texture, NULL, &video->screen, &tex_pitch);
-
-    for (io->v_count.w = 0; io->v_count.w < LINES_TOTAL; io->v_count.w++) {
-        io->disp_stat.w &= ~(HBLK_FLAG | VCNT_FLAG);
-
-        if (io->v_count.w == io->disp_stat.b.b1)
-            video->vcount_match();
+    if (io->v_count.w == 0)
+        io->disp_stat.w &= ~VBLK_FLAG;
+    io->disp_stat.w &= ~(HBLK_FLAG | VCNT_FLAG);
 
-        if (io->v_count.w == LINES_VISIBLE) {
-            io->bg_refxi[2].w = io->bg_refxe[2].w;
-            io->bg_refyi[2].w = io->bg_refye[2].w;
-            io->bg_refxi[3].w = io->bg_refxe[3].w;
-            io->bg_refyi[3].w = io->bg_refye[3].w;
-            video->vblank_start();
-            dma->dma_transfer(VBLANK);
-        }
+    if (io->v_count.w == io->disp_stat.b.b1)
+        video->vcount_match();
 
-        cpu->arm_exec(CYC_LINE_HBLK0);
-
-        if (io->v_count.w < LINES_VISIBLE) {
-            video->render_line();
-            dma->dma_transfer(HBLANK);
-        }
-
-        video->hblank_start();
-        cpu->arm_exec(CYC_LINE_HBLK1);
-        sound->sound_clock(CYC_LINE_TOTAL);
+    if (io->v_count.w == LINES_VISIBLE) {
+        io->bg_refxi[2].w = io->bg_refxe[2].w;
+        io->bg_refyi[2].w = io->bg_refye[2].w;
+        io->bg_refxi[3].w = io->bg_refxe[3].w;
+        io->bg_refyi[3].w = io->bg_refye[3].w;
+        video->vblank_start();
+        uint64_t start = phase_now();
+        dma->dma_transfer(VBLANK);
+        phase_add(PHASE_DMA, start);
     }
-
-    SDL_UnlockTexture(texture);
-    SDL_RenderCopy(renderer, texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
-    sound->sound_buffer_wrap();
+    sched->sched_add(EVT_HBLANK, when + CYC_LINE_HBLK0);
+    sched->sched_add(EVT_HDRAW, when + CYC_LINE_TOTAL);
 }
-void GBA::start()
+void GBA::line_next(uint64_t when)
 {
-    bool run = true;
-    while (run) {
-        run_frame();
-
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
-                case SDL_KEYDOWN:
-                    switch (event.key.keysym.sym) {
-                        case SDLK_UP:
-                            io->key_input.w &= ~BTN_U;
-                            break;
-                        case SDLK_DOWN:
-                            io->key_input.w &= ~BTN_D;
-                            break;
-                        case SDLK_LEFT:
-                            io->key_input.w &= ~BTN_L;
-                            break;
-                        case SDLK_RIGHT:
-                            io->key_input.w &= ~BTN_R;
-                            break;
-                        case SDLK_a:
-                            io->key_input.w &= ~BTN_A;
-                            break;
-                        case SDLK_s:
-                            io->key_input.w &= ~BTN_B;
-                            break;
-                        case SDLK_q:
-                            io->key_input.w &= ~BTN_LT;
-                            break;
-                        case SDLK_w:
-                            io->key_input.w &= ~BTN_RT;
-                            break;
-                        case SDLK_TAB:
-                            io->key_input.w &= ~BTN_SEL;
-                            break;
-                        case SDLK_RETURN:
-                            io->key_input.w &= ~BTN_STA;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
-                case SDL_KEYUP:
-                    switch (event.key.keysym.sym) {
-                        case SDLK_UP:
-                            io->key_input.w |= BTN_U;
-                            break;
-                        case SDLK_DOWN:
-                            io->key_input.w |= BTN_D;
-                            break;
-                        case SDLK_LEFT:
-                            io->key_input.w |= BTN_L;
-                            break;
-                        case SDLK_RIGHT:
-                            io->key_input.w |= BTN_R;
-                            break;
-                        case SDLK_a:
-                            io->key_input.w |= BTN_A;
-                            break;
-                        case SDLK_s:
-                            io->key_input.w |= BTN_B;
-                            break;
-                        case SDLK_q:
-                            io->key_input.w |= BTN_LT;
-                            break;
-                        case SDLK_w:
-                            io->key_input.w |= BTN_RT;
-                            break;
-                        case SDLK_TAB:
-                            io->key_input.w |= BTN_SEL;
-                            break;
-                        case SDLK_RETURN:
-                            io->key_input.w |= BTN_STA;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
-                case SDL_QUIT:
-                    run = false;
-                    break;
-            }
-        }
+    if (++io->v_count.w == LINES_TOTAL) {
+        io->v_count.w = 0;
+        frame_done    = true;
+    }
+    line_start(when);
+}
+void GBA::line_hblank()
+{
+    if (io->v_count.w < LINES_VISIBLE) {
+        uint64_t start = phase_now();
+        video->render_line();
+        phase_add(PHASE_VIDEO, start);
+        start = phase_now();
+        dma->dma_transfer(HBLANK);
+        phase_add(PHASE_DMA, start);
     }
+    video->hblank_start();
+}
+void GBA::run_frame()
+{
+    frame_done = false;
+    while (!frame_done)
+        sched->sched_run();
 }
-int GBA::init(char *argv[])
+bool GBA::init(const char *romname, uint32_t *_frame_buf, int16_t *_snd_buf)
 {
+    frame_buf         = _frame_buf;
+    snd_buf           = _snd_buf;
+    video->screen     = frame_buf;
+    sound->snd_buffer = snd_buf;
+    memset(snd_buf, 0, BUFF_SAMPLES * sizeof(int16_t));
+
     cpu->arm_init();
+    sound->sound_reset();
     memcpy(bios, bios_bin, sizeof(bios_bin));
-    if (!open_rom(argv[1]))
-        return 0;
-
-    sdl_init();
+    if (!open_rom(romname)) {
+        cpu->arm_uninit();
+        return false;
+    }
     cpu->arm_reset();
+    sched->sched_reset();
+    memset(phase_ns, 0, sizeof(phase_ns));
+    return true;
+}
+void GBA::uninit()
+{
+    cpu->arm_uninit();
+}
+uint32_t GBA::state_block(uint8_t *buf, uint32_t pos, void *data, uint32_t size, bool save)
+{
+    if (buf) {
+        if (save)
+            memcpy(buf + pos, data, size);
+        else
+            memcpy(data, buf + pos, size);
+    } else if (!save) {
+        memset(data, 0, size);
+    }
+    return pos + size;
+}
+// Every piece of emulation state, in blob order. A null buf only measures the size, or zeroes the state on load.
+// Ranges copy consecutive plain data members, keep pointers out of them.
+#define STATE_BLOCK(data, size)  pos = state_block(buf, pos, data, size, save)
+#define STATE_VAR(var)           STATE_BLOCK(&(var), sizeof(var))
+#define STATE_RANGE(first, last) STATE_BLOCK(&(first), (uint8_t *)(&(last) + 1) - (uint8_t *)&(first))
+uint32_t GBA::state_sync(uint8_t *buf, bool save)
+{
+    uint32_t pos = sizeof(state_hdr_t);
 
-    start();
+    // Pending lazy flags are folded into CPSR so the layout stays the same
+    cpu->arm_flags_sync();
+    STATE_VAR(cpu->arm_r);
+    STATE_VAR(cpu->arm_op);
+    STATE_VAR(cpu->arm_pipe);
+    STATE_VAR(cpu->arm_cycles);
+    STATE_VAR(cpu->int_halt);
+    STATE_VAR(cpu->pipe_reload);
 
-    sdl_uninit();
-    cpu->arm_uninit();
-    return 0;
-}
\ No newline at end of file
+    STATE_BLOCK(mem->wram, WRAM_SZ);
+    STATE_BLOCK(mem->iwram, IWRAM_SZ);
+    STATE_BLOCK(mem->pram, PRAM_SZ);
+    STATE_BLOCK(mem->vram, VRAM_SZ);
+    STATE_BLOCK(mem->oam, OAM_SZ);
+    STATE_BLOCK(mem->eeprom, EEPROM_SZ);
+    STATE_BLOCK(mem->sram, SRAM_SZ);
+    STATE_BLOCK(mem->flash, FLASH_SZ);
+    STATE_RANGE(mem->bios_op, mem->palette);
+
+    STATE_RANGE(io->disp_cnt, io->io_open_bus);
+    STATE_VAR(io->bg);
+    STATE_VAR(io->dma_ch);
+
+    STATE_RANGE(dma->dma_src_addr, dma->dma_count);
+    STATE_VAR(timer->tmr_icnt);
+    STATE_VAR(timer->tmr_enb);
+    STATE_VAR(timer->tmr_cycles);
+
+    STATE_RANGE(sound->fifo_a, sound->fifo_b_len);
+    STATE_RANGE(sound->fifo_a_samp, sound->snd_ch_state);
+
+    STATE_RANGE(sched->now, sched->evt_enb);
+    return pos;
+}
+#undef STATE_BLOCK
+#undef STATE_VAR
+#undef STATE_RANGE
+uint32_t GBA::state_size()
+{
+    return state_sync(nullptr, true);
+}
+uint32_t GBA::save_state(uint8_t *buf)
+{
+    state_hdr_t hdr = {.magic = STATE_MAGIC, .version = STATE_VERSION, .size = state_sync(buf, true)};
+    memcpy(buf, &hdr, sizeof(hdr));
+    return hdr.size;
+}
+bool GBA::load_state(const uint8_t *buf, uint32_t size)
+{
+    state_hdr_t hdr;
+    if (size < sizeof(hdr))
+        return false;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != STATE_MAGIC || hdr.version != STATE_VERSION || hdr.size != size || size != state_size())
+        return false;
+    state_sync((uint8_t *)buf, false);
+    // Cached decode of RAM code may no longer match the restored memory
+    cpu->arm_idle_clear();
+    cpu->arm_fetch_clear();
+    cpu->arm_blk_flush();
+    return true;
+}
+uint64_t GBA::phase_now()
+{
+    if (!phase_enb)
+        return 0;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+void GBA::phase_add(gba_phase_e phase, uint64_t start)
+{
+    if (phase_enb)
+        phase_ns[phase] += phase_now() - start;
+}
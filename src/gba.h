@@ -1,8 +1,8 @@
 #ifndef _GBA_H_
 #define _GBA_H_
 
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_render.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 
 class CPU;
@@ -12,6 +12,28 @@ class IO;
 class SOUND;
 class TIMER;
 class VIDEO;
+class SCHED;
+class HLE;
+class TRACE;
+
+#define STATE_MAGIC   0x53414247    // "GBAS"
+#define STATE_VERSION 3
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;    // Whole blob, header included
+} state_hdr_t;
+
+typedef enum
+{
+    PHASE_CPU   = 0,
+    PHASE_VIDEO = 1,
+    PHASE_SOUND = 2,
+    PHASE_DMA   = 3,
+    PHASE_COUNT = 4
+} gba_phase_e;
 
 class GBA {
   public:
@@ -22,29 +44,47 @@ class GBA {
     SOUND *sound = nullptr;
     TIMER *timer = nullptr;
     VIDEO *video = nullptr;
+    SCHED *sched = nullptr;
+    HLE   *hle   = nullptr;
+#ifdef GBA_TRACE
+    TRACE *trace = nullptr;
+#endif
 
-    SDL_Window   *window;
-    SDL_Renderer *renderer;
-    SDL_Texture  *texture;
-
-    int32_t  tex_pitch;
     uint8_t *bios;
     int64_t  cart_rom_size;
     uint32_t cart_rom_mask;
     uint8_t *rom;
+    bool     frame_done;
+
+    // Caller owned outputs, 240x160 BGRA8888 pixels and a BUFF_SAMPLES stereo ring
+    uint32_t *frame_buf = nullptr;
+    int16_t  *snd_buf   = nullptr;
+
+    // Host time per emulation phase, only collected while phase_enb is set
+    bool     phase_enb = false;
+    uint64_t phase_ns[PHASE_COUNT];
 
     const int64_t max_rom_sz = 32 * 1024 * 1024;
 
   public:
     GBA();
+    ~GBA();
 
-    void     start();
     uint32_t to_pow2(uint32_t val);
-    void     sdl_init();
-    void     sdl_uninit();
-    bool     open_rom(char *romname);
-    int      init(char *argv[]);
+    bool     open_rom(const char *romname);
+    bool     init(const char *romname, uint32_t *_frame_buf, int16_t *_snd_buf);
+    void     uninit();
+    uint32_t state_block(uint8_t *buf, uint32_t pos, void *data, uint32_t size, bool save);
+    uint32_t state_sync(uint8_t *buf, bool save);
+    uint32_t state_size();
+    uint32_t save_state(uint8_t *buf);
+    bool     load_state(const uint8_t *buf, uint32_t size);
+    uint64_t phase_now();
+    void     phase_add(gba_phase_e phase, uint64_t start);
 
+    void line_start(uint64_t when);
+    void line_next(uint64_t when);
+    void line_hblank();
     void run_frame();
 };
 #endif
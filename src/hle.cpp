@@ -0,0 +1,296 @@
+#include <string.h>
+#include "arm.h"
+#include "hle.h"
+#include "mem.h"
+
+// Rough per step costs of the assembled BIOS, fitted against the interpreter
+#define HLE_SWI_CYCLES      60            // Exception entry, table dispatch and return
+#define HLE_DIV_CYCLES      300
+#define HLE_SQRT_CYCLES     130
+#define HLE_SET_CYCLES      5             // CpuSet loop overhead per unit, bus accesses come on top
+#define HLE_FAST_SET_CYCLES 1             // CpuFastSet, per word
+#define HLE_LZ77_FLAG       10
+#define HLE_LZ77_LIT        17
+#define HLE_LZ77_WIN        15
+#define HLE_LZ77_COPY       16
+#define HLE_RL_BLOCK        23
+#define HLE_RL_BYTE         12
+#define HLE_HUFF_BIT        17
+#define HLE_HUFF_SYM        13
+#define HLE_BIOS_OP         0xeafffffe    // Last BIOS word prefetched before the handler returns
+
+
+HLE::HLE(GBA *_gba)
+{
+    gba = _gba;
+}
+bool HLE::hle_swi(uint8_t num)
+{
+    CPU *cpu = gba->cpu;
+    switch (num) {
+        case SWI_DIV:
+            hle_div(cpu->arm_r.r[0], cpu->arm_r.r[1]);
+            break;
+        case SWI_DIV_ARM:
+            hle_div(cpu->arm_r.r[1], cpu->arm_r.r[0]);
+            break;
+        case SWI_SQRT:
+            hle_sqrt();
+            break;
+        case SWI_CPU_SET:
+            hle_cpu_set();
+            break;
+        case SWI_CPU_FAST_SET:
+            hle_cpu_fast_set();
+            break;
+        case SWI_LZ77_WRAM:
+        case SWI_LZ77_VRAM:
+            hle_lz77(num == SWI_LZ77_VRAM);
+            break;
+        case SWI_HUFF:
+            hle_huff();
+            break;
+        case SWI_RL_WRAM:
+        case SWI_RL_VRAM:
+            hle_rl(num == SWI_RL_VRAM);
+            break;
+        default:
+            return false;
+    }
+    cpu->arm_cycles += HLE_SWI_CYCLES;
+    gba->mem->bios_op = HLE_BIOS_OP;
+    return true;
+}
+void HLE::hle_div(int32_t num, int32_t den)
+{
+    CPU *cpu = gba->cpu;
+    // Hardware BIOS results, the remainder keeps the sign of the numerator
+    if (den == 0) {
+        cpu->arm_r.r[0] = num < 0 ? -1 : 1;
+        cpu->arm_r.r[1] = num;
+        cpu->arm_r.r[3] = 1;
+    } else {
+        int64_t quot    = (int64_t)num / den;
+        cpu->arm_r.r[0] = quot;
+        cpu->arm_r.r[1] = (int64_t)num % den;
+        cpu->arm_r.r[3] = quot < 0 ? -quot : quot;
+    }
+    cpu->arm_cycles += HLE_DIV_CYCLES;
+}
+void HLE::hle_sqrt()
+{
+    CPU     *cpu = gba->cpu;
+    uint32_t val = cpu->arm_r.r[0];
+    uint32_t res = 0;
+    uint32_t bit = 1 << 30;
+    while (bit > val)
+        bit >>= 2;
+    while (bit) {
+        if (val >= res + bit) {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    cpu->arm_r.r[0] = res;
+    cpu->arm_cycles += HLE_SQRT_CYCLES;
+}
+void HLE::hle_set(uint32_t cnt, bool fill, uint8_t size, uint32_t unit_cycles)
+{
+    CPU     *cpu = gba->cpu;
+    MEM     *mem = gba->mem;
+    uint32_t src = cpu->arm_r.r[0] & ~(size - 1);
+    uint32_t dst = cpu->arm_r.r[1] & ~(size - 1);
+    uint32_t len = cnt * size;
+    uint32_t i;
+    if (!cnt)
+        return;
+    mem->arm_access_block(src, size, fill ? 1 : cnt);
+    mem->arm_access_block(dst, size, cnt);
+    cpu->arm_cycles += cnt * unit_cycles;
+
+    // Plain memory on both ends copies in one go, overlapping copies keep the BIOS forward order
+    uint8_t *sp = mem->page_block_ptr(mem->read_page, src, fill ? size : len);
+    uint8_t *dp = mem->page_block_ptr(mem->write_page, dst, len);
+    if (sp && dp && fill) {
+        if (size == ARM_WORD_SZ) {
+            uint32_t val = *(uint32_t *)sp;
+            for (i = 0; i < cnt; i++)
+                ((uint32_t *)dp)[i] = val;
+        } else {
+            uint16_t val = *(uint16_t *)sp;
+            for (i = 0; i < cnt; i++)
+                ((uint16_t *)dp)[i] = val;
+        }
+    } else if (sp && dp && (sp + len <= dp || dp + len <= sp)) {
+        memcpy(dp, sp, len);
+    } else if (size == ARM_WORD_SZ) {
+        uint32_t val = mem->arm_read(src);
+        for (i = 0; i < cnt; i++) {
+            if (!fill)
+                val = mem->arm_read(src + i * 4);
+            mem->arm_write(dst + i * 4, val);
+        }
+    } else {
+        uint16_t val = mem->arm_readh(src);
+        for (i = 0; i < cnt; i++) {
+            if (!fill)
+                val = mem->arm_readh(src + i * 2);
+            mem->arm_writeh(dst + i * 2, val);
+        }
+    }
+    if (!fill)
+        cpu->arm_r.r[0] += len;
+    cpu->arm_r.r[1] += len;
+}
+void HLE::hle_cpu_set()
+{
+    uint32_t ctrl = gba->cpu->arm_r.r[2];
+    hle_set(ctrl & 0x1fffff, ctrl & (1 << 24), ctrl & (1 << 26) ? ARM_WORD_SZ : ARM_HWORD_SZ, HLE_SET_CYCLES);
+}
+void HLE::hle_cpu_fast_set()
+{
+    // Always whole blocks of 8 words
+    uint32_t ctrl = gba->cpu->arm_r.r[2];
+    hle_set(((ctrl & 0x1fffff) + 7) & ~7, ctrl & (1 << 24), ARM_WORD_SZ, HLE_FAST_SET_CYCLES);
+}
+void HLE::hle_lz77_put(uint32_t dst, uint8_t val, bool vram, uint16_t *half)
+{
+    // VRAM only takes halfwords, the even byte waits for its odd neighbour
+    if (!vram)
+        gba->mem->arm_writeb(dst, val);
+    else if (dst & 1)
+        gba->mem->arm_writeh(dst, *half | val << 8);
+    else
+        *half = val;
+}
+void HLE::hle_lz77(bool vram)
+{
+    CPU     *cpu   = gba->cpu;
+    MEM     *mem   = gba->mem;
+    uint32_t src   = cpu->arm_r.r[0];
+    uint32_t dst   = cpu->arm_r.r[1];
+    uint32_t len   = mem->arm_read(src) >> 8;
+    uint16_t half  = 0;
+    uint32_t flags = 0, lits = 0, wins = 0, copies = 0;
+    src += 4;
+    while (len) {
+        uint8_t enc = mem->arm_readb(src++);
+        flags++;
+        for (uint8_t b = 0; b < 8 && len; b++, enc <<= 1) {
+            if (!(enc & 0x80)) {
+                hle_lz77_put(dst++, mem->arm_readb(src++), vram, &half);
+                lits++;
+                len--;
+                continue;
+            }
+            uint8_t  hi   = mem->arm_readb(src++);
+            uint8_t  lo   = mem->arm_readb(src++);
+            uint32_t disp = ((hi << 8 | lo) & 0xfff) + 1;
+            uint32_t n    = (hi >> 4) + 3;
+            wins++;
+            for (; n && len; n--, len--, copies++) {
+                hle_lz77_put(dst, mem->arm_readb(dst - disp), vram, &half);
+                dst++;
+            }
+        }
+    }
+    cpu->arm_r.r[0] = src;
+    cpu->arm_r.r[1] = dst;
+    cpu->arm_cycles += flags * HLE_LZ77_FLAG + lits * HLE_LZ77_LIT + wins * HLE_LZ77_WIN + copies * HLE_LZ77_COPY;
+}
+void HLE::hle_huff()
+{
+    CPU     *cpu = gba->cpu;
+    MEM     *mem = gba->mem;
+    uint32_t src = cpu->arm_r.r[0];
+    uint32_t dst = cpu->arm_r.r[1];
+    uint32_t hdr = mem->arm_read(src);
+    src += 4;
+    // Empty streams and sources below WRAM are rejected
+    if (!(hdr >> 8) || !(src >> 25)) {
+        cpu->arm_r.r[0] = src;
+        return;
+    }
+    uint8_t  size   = hdr & 0xf;
+    int32_t  len    = hdr >> 8;
+    uint32_t tree   = src + 1;
+    uint32_t stream = tree + mem->arm_readb(src) * 2 + 1;
+    uint32_t node   = tree;
+    uint32_t buf    = 0;
+    uint8_t  unit   = 0;
+    uint32_t bits = 0, syms = 0;
+    while (len > 0) {
+        uint32_t data = mem->arm_read(stream);
+        stream += 4;
+        for (uint8_t b = 0; b < 32 && len > 0; b++) {
+            uint32_t n   = mem->arm_readb(node);
+            uint8_t  dir = data >> 31;
+            data <<= 1;
+            node = (node & ~1) + ((n & 0x3f) + 1) * 2 + dir;
+            bits++;
+            // Bit 7 flags the left child as data, bit 6 the right one
+            if (!((n << dir) & 0x80))
+                continue;
+            buf |= (uint32_t)mem->arm_readb(node) << unit;
+            node = tree;
+            unit = (unit + size) & 31;
+            syms++;
+            if (unit)
+                continue;
+            mem->arm_write(dst, buf);
+            dst += 4;
+            buf = 0;
+            len -= 4;
+        }
+    }
+    cpu->arm_r.r[0] = tree;
+    cpu->arm_r.r[1] = dst;
+    cpu->arm_cycles += bits * HLE_HUFF_BIT + syms * HLE_HUFF_SYM;
+}
+void HLE::hle_rl(bool vram)
+{
+    CPU     *cpu = gba->cpu;
+    MEM     *mem = gba->mem;
+    uint32_t src = cpu->arm_r.r[0];
+    uint32_t dst = cpu->arm_r.r[1];
+    int32_t  len = mem->arm_read(src) >> 8;
+    src += 4;
+    if (!len || !(src >> 25)) {
+        cpu->arm_r.r[0] = src;
+        return;
+    }
+    // The 16-bit variant drops a trailing odd byte like the BIOS does
+    uint16_t half   = 0;
+    uint8_t  shift  = 0;
+    uint32_t blocks = 0, bytes = 0;
+    while (len > 0) {
+        uint8_t  flags = mem->arm_readb(src++);
+        bool     run   = flags & 0x80;
+        uint32_t n     = (flags & 0x7f) + (run ? 3 : 1);
+        uint8_t  val   = run ? mem->arm_readb(src++) : 0;
+        len -= n;
+        blocks++;
+        bytes += n;
+        while (n--) {
+            if (!run)
+                val = mem->arm_readb(src++);
+            if (!vram) {
+                mem->arm_writeb(dst++, val);
+                continue;
+            }
+            half |= val << shift;
+            shift ^= 8;
+            if (!shift) {
+                mem->arm_writeh(dst, half);
+                dst += 2;
+                half = 0;
+            }
+        }
+    }
+    cpu->arm_r.r[0] = src;
+    cpu->arm_r.r[1] = dst;
+    cpu->arm_cycles += blocks * HLE_RL_BLOCK + bytes * HLE_RL_BYTE;
+}
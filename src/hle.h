@@ -0,0 +1,42 @@
+#ifndef _HLE_H_
+#define _HLE_H_
+
+#include <stdint.h>
+#include "gba.h"
+
+// BIOS calls that have a native implementation
+#define SWI_DIV          0x06
+#define SWI_DIV_ARM      0x07
+#define SWI_SQRT         0x08
+#define SWI_CPU_SET      0x0b
+#define SWI_CPU_FAST_SET 0x0c
+#define SWI_LZ77_WRAM    0x11
+#define SWI_LZ77_VRAM    0x12
+#define SWI_HUFF         0x13
+#define SWI_RL_WRAM      0x14
+#define SWI_RL_VRAM      0x15
+
+
+// Native versions of the BIOS calls that dominate load times. Each one leaves memory and r0-r3 the way the
+// BIOS does on return and charges roughly the cycles the interpreted call would have taken.
+class HLE {
+  public:
+    GBA *gba = nullptr;
+
+  public:
+    HLE(GBA *_gba);
+
+    bool hle_swi(uint8_t num);
+
+    void hle_div(int32_t num, int32_t den);
+    void hle_sqrt();
+    void hle_set(uint32_t cnt, bool fill, uint8_t size, uint32_t unit_cycles);
+    void hle_cpu_set();
+    void hle_cpu_fast_set();
+    void hle_lz77_put(uint32_t dst, uint8_t val, bool vram, uint16_t *half);
+    void hle_lz77(bool vram);
+    void hle_huff();
+    void hle_rl(bool vram);
+};
+
+#endif
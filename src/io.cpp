@@ -12,6 +12,8 @@ IO::IO(GBA *_gba)
 uint8_t IO::io_read(uint32_t address)
 {
     io_open_bus = false;
+    if (address >= 0x04000100 && address <= 0x0400010f)
+        gba->timer->timers_sync();
     switch (address) {
         case 0x04000000:
             return disp_cnt.b.b0 & 0xff;
@@ -303,6 +305,7 @@ void IO::dma_load(uint8_t ch, uint8_t value)
 }
 void IO::tmr_load(uint8_t idx, uint8_t value)
 {
+    gba->timer->timers_sync();
     uint8_t old        = tmr[idx].ctrl.b.b0;
     tmr[idx].ctrl.b.b0 = value;
     if (value & TMR_ENB)
@@ -313,23 +316,12 @@ void IO::tmr_load(uint8_t idx, uint8_t value)
         tmr[idx].count.w          = tmr[idx].reload.w;
         gba->timer->tmr_icnt[idx] = 0;
     }
+    gba->timer->timers_schedule();
 }
 void IO::snd_reset_state(uint8_t ch, bool enb)
 {
     if (enb) {
-        gba->sound->snd_ch_state[ch].phase       = false;
-        gba->sound->snd_ch_state[ch].samples     = 0;
-        gba->sound->snd_ch_state[ch].length_time = 0;
-        gba->sound->snd_ch_state[ch].sweep_time  = 0;
-        gba->sound->snd_ch_state[ch].env_time    = 0;
-        if (ch == 2)
-            gba->sound->wave_reset();
-        if (ch == 3) {
-            if (noise_ch.ctrl.w & NOISE_7)
-                gba->sound->snd_ch_state[ch].lfsr = 0x007f;
-            else
-                gba->sound->snd_ch_state[ch].lfsr = 0x7fff;
-        }
+        gba->sound->psg_trigger(ch);
         snd_psg_enb.w |= (1 << ch);
     }
 }
@@ -572,20 +564,25 @@ void IO::io_write(uint32_t address, uint8_t value)
                 sqr_ch[0].sweep.b.b1 = value;
             break;
         case 0x04000062:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[0].tone.b.b0 = value;
+                gba->sound->psg_length(0);
+            }
             break;
         case 0x04000063:
             if (snd_psg_enb.w & PSG_ENB)
                 sqr_ch[0].tone.b.b1 = value;
             break;
         case 0x04000064:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[0].ctrl.b.b0 = value;
+                gba->sound->psg_period(0);
+            }
             break;
         case 0x04000065:
             if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[0].ctrl.b.b1 = value;
+                gba->sound->psg_period(0);
                 snd_reset_state(0, value & 0x80);
             }
             break;
@@ -598,20 +595,25 @@ void IO::io_write(uint32_t address, uint8_t value)
                 sqr_ch[0].ctrl.b.b3 = value;
             break;
         case 0x04000068:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[1].tone.b.b0 = value;
+                gba->sound->psg_length(1);
+            }
             break;
         case 0x04000069:
             if (snd_psg_enb.w & PSG_ENB)
                 sqr_ch[1].tone.b.b1 = value;
             break;
         case 0x0400006c:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[1].ctrl.b.b0 = value;
+                gba->sound->psg_period(1);
+            }
             break;
         case 0x0400006d:
             if (snd_psg_enb.w & PSG_ENB) {
                 sqr_ch[1].ctrl.b.b1 = value;
+                gba->sound->psg_period(1);
                 snd_reset_state(1, value & 0x80);
             }
             break;
@@ -632,20 +634,25 @@ void IO::io_write(uint32_t address, uint8_t value)
                 wave_ch.wave.b.b1 = value;
             break;
         case 0x04000072:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 wave_ch.volume.b.b0 = value;
+                gba->sound->psg_length(2);
+            }
             break;
         case 0x04000073:
             if (snd_psg_enb.w & PSG_ENB)
                 wave_ch.volume.b.b1 = value;
             break;
         case 0x04000074:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 wave_ch.ctrl.b.b0 = value;
+                gba->sound->psg_period(2);
+            }
             break;
         case 0x04000075:
             if (snd_psg_enb.w & PSG_ENB) {
                 wave_ch.ctrl.b.b1 = value;
+                gba->sound->psg_period(2);
                 snd_reset_state(2, value & 0x80);
             }
             break;
@@ -658,8 +665,10 @@ void IO::io_write(uint32_t address, uint8_t value)
                 wave_ch.ctrl.b.b3 = value;
             break;
         case 0x04000078:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 noise_ch.env.b.b0 = value;
+                gba->sound->psg_length(3);
+            }
             break;
         case 0x04000079:
             if (snd_psg_enb.w & PSG_ENB)
@@ -674,8 +683,10 @@ void IO::io_write(uint32_t address, uint8_t value)
                 noise_ch.env.b.b3 = value;
             break;
         case 0x0400007c:
-            if (snd_psg_enb.w & PSG_ENB)
+            if (snd_psg_enb.w & PSG_ENB) {
                 noise_ch.ctrl.b.b0 = value;
+                gba->sound->psg_period(3);
+            }
             break;
         case 0x0400007d:
             if (snd_psg_enb.w & PSG_ENB) {
@@ -1087,4 +1098,6 @@ void IO::update_ws()
         ws_n_arm[i] = ws_n_t16[i] + ws_s_t16[i];
         ws_s_arm[i] = ws_s_t16[i] << 1;
     }
+    // The cached fetch costs of a ROM region are stale now
+    gba->cpu->arm_fetch_clear();
 }
\ No newline at end of file
@@ -1,8 +0,0 @@
-#include "gba.h"
-
-
-int main(int argc, char *argv[])
-{
-    GBA *gba = new GBA();
-    gba->init(argv);
-}
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "arm.h"
 #include "mem.h"
 #include "io.h"
@@ -11,6 +12,114 @@ MEM::MEM(GBA *_gba)
 {
     gba = _gba;
 }
+void MEM::page_set(mem_page_t *page, uint8_t *ptr, uint32_t mask)
+{
+    page->ptr  = ptr;
+    page->mask = mask;
+    page->code = nullptr;
+}
+void MEM::page_map_init()
+{
+    uint32_t idx;
+    for (idx = 0; idx < PAGE_COUNT; idx++) {
+        uint32_t    address = idx << PAGE_SHIFT;
+        uint32_t    vram_a  = address & 0x1ffff;
+        mem_page_t *rp      = &read_page[idx];
+        mem_page_t *wp      = &write_page[idx];
+        page_set(rp, nullptr, 0);
+        page_set(wp, nullptr, 0);
+        switch (address >> 24) {
+            case 0x2:
+                page_set(rp, wram + (address & 0x3ffff), 0x7fff);
+                page_set(wp, wram + (address & 0x3ffff), 0x7fff);
+                wp->code = code_line + ((address & 0x3ffff) >> CODE_LINE_SHIFT);
+                break;
+            case 0x3:
+                page_set(rp, iwram, 0x7fff);
+                page_set(wp, iwram, 0x7fff);
+                wp->code = code_line + (WRAM_SZ >> CODE_LINE_SHIFT);
+                break;
+            case 0x5:
+                // Writes also update the converted palette
+                page_set(rp, pram, 0x3ff);
+                break;
+            case 0x6:
+                page_set(rp, vram + (vram_a & (vram_a & 0x10000 ? 0x17fff : 0x1ffff)), 0x7fff);
+                page_set(wp, vram + (vram_a & (vram_a & 0x10000 ? 0x17fff : 0x1ffff)), 0x7fff);
+                break;
+            case 0x7:
+                page_set(rp, oam, 0x3ff);
+                page_set(wp, oam, 0x3ff);
+                break;
+            case 0x8:
+            case 0x9:
+            case 0xa:
+            case 0xb:
+                page_set(rp, gba->rom + (address & gba->cart_rom_mask), 0x7fff & gba->cart_rom_mask);
+                break;
+        }
+    }
+}
+uint8_t *MEM::page_read_ptr(uint32_t address)
+{
+    if (address >> 28)
+        return nullptr;
+    mem_page_t *page = &read_page[address >> PAGE_SHIFT];
+    if (!page->ptr)
+        return nullptr;
+    return page->ptr + (address & page->mask);
+}
+uint8_t *MEM::page_write_ptr(uint32_t address)
+{
+    if (address >> 28)
+        return nullptr;
+    mem_page_t *page = &write_page[address >> PAGE_SHIFT];
+    if (!page->ptr)
+        return nullptr;
+    uint32_t offset = address & page->mask;
+    if (page->code && page->code[offset >> CODE_LINE_SHIFT])
+        code_invalidate(page->code + (offset >> CODE_LINE_SHIFT));
+    return page->ptr + offset;
+}
+uint8_t *MEM::page_block_ptr(mem_page_t *page, uint32_t address, uint32_t len)
+{
+    // Whole range has to sit inside one page without wrapping a mirror
+    if (!len || (address >> 28))
+        return nullptr;
+    page += address >> PAGE_SHIFT;
+    uint32_t offset = address & page->mask;
+    if (!page->ptr || offset + len - 1 > page->mask)
+        return nullptr;
+    if (page->code) {
+        for (uint32_t line = offset >> CODE_LINE_SHIFT; line <= (offset + len - 1) >> CODE_LINE_SHIFT; line++) {
+            if (page->code[line])
+                code_invalidate(page->code + line);
+        }
+    }
+    return page->ptr + offset;
+}
+uint16_t MEM::code_line_idx(uint32_t address)
+{
+    switch (address >> 24) {
+        case 0x2:
+            return (address & 0x3ffff) >> CODE_LINE_SHIFT;
+        case 0x3:
+            return (WRAM_SZ + (address & 0x7fff)) >> CODE_LINE_SHIFT;
+    }
+    return CODE_LINE_NONE;
+}
+void MEM::code_invalidate(uint8_t *line)
+{
+    // Blocks decoded from the line are rebuilt on their next lookup, the running one stops after this store
+    *line = 0;
+    code_gen[line - code_line]++;
+    gba->cpu->t_exit = true;
+}
+void MEM::code_clear()
+{
+    memset(code_line, 0, sizeof(code_line));
+    memset(code_gen, 0, sizeof(code_gen));
+}
 void MEM::arm_access(uint32_t address, access_type_e at)
 {
     uint8_t cycles = 1;
@@ -35,6 +144,13 @@ void MEM::arm_access_bus(uint32_t address, uint8_t size, access_type_e at)
         arm_access(address, at);
     }
 }
+void MEM::arm_access_block(uint32_t address, uint8_t size, uint32_t cnt)
+{
+    // Every access of a block shares one region and is charged as sequential, so one access scales
+    uint32_t start = gba->cpu->arm_cycles;
+    arm_access_bus(address, size, SEQUENTIAL);
+    gba->cpu->arm_cycles += (gba->cpu->arm_cycles - start) * (cnt - 1);
+}
 uint8_t MEM::bios_read(uint32_t address)
 {
     if ((address | gba->cpu->arm_r.r[15]) < 0x4000)
@@ -143,6 +259,11 @@ uint8_t MEM::arm_read_(uint32_t address, uint8_t offset)
 }
 uint8_t MEM::arm_readb(uint32_t address)
 {
+    uint8_t *ptr = page_read_ptr(address);
+    if (ptr) {
+        gba->io->io_open_bus &= (address & 0x08000000) != 0;
+        return *ptr;
+    }
     uint8_t value = arm_read_(address, 0);
     if (!(address & 0x08000000)) {
         gba->io->io_open_bus &= ((address >> 24) == 4);
@@ -153,8 +274,13 @@ uint8_t MEM::arm_readb(uint32_t address)
 }
 uint32_t MEM::arm_readh(uint32_t address)
 {
-    uint32_t a     = address & ~1;
-    uint8_t  s     = address & 1;
+    uint32_t a   = address & ~1;
+    uint8_t  s   = address & 1;
+    uint8_t *ptr = page_read_ptr(a);
+    if (ptr) {
+        gba->io->io_open_bus &= (a & 0x08000000) != 0;
+        return ROR((uint32_t)(*(uint16_t *)ptr), s << 3);
+    }
     uint32_t value = arm_read_(a | 0, 0) << 0 | arm_read_(a | 1, 1) << 8;
     if (!(a & 0x08000000)) {
         gba->io->io_open_bus &= ((a >> 24) == 4);
@@ -167,8 +293,13 @@ uint32_t MEM::arm_readh(uint32_t address)
 }
 uint32_t MEM::arm_read(uint32_t address)
 {
-    uint32_t a = address & ~3;
-    uint8_t  s = address & 3;
+    uint32_t a   = address & ~3;
+    uint8_t  s   = address & 3;
+    uint8_t *ptr = page_read_ptr(a);
+    if (ptr) {
+        gba->io->io_open_bus &= (a & 0x08000000) != 0;
+        return ROR(*(uint32_t *)ptr, s << 3);
+    }
     uint32_t value =
         arm_read_(a | 0, 0) << 0 | arm_read_(a | 1, 1) << 8 | arm_read_(a | 2, 2) << 16 | arm_read_(a | 3, 3) << 24;
     if (!(a & 0x08000000)) {
@@ -210,6 +341,15 @@ uint32_t MEM::arm_read_s(uint32_t address)
     arm_access_bus(address, ARM_WORD_SZ, SEQUENTIAL);
     return arm_read(address);
 }
+uint32_t *MEM::arm_read_block(uint32_t address, uint8_t cnt)
+{
+    uint32_t *ptr = (uint32_t *)page_block_ptr(read_page, address, cnt * 4);
+    if (ptr) {
+        arm_access_block(address, ARM_WORD_SZ, cnt);
+        gba->io->io_open_bus &= (address & 0x08000000) != 0;
+    }
+    return ptr;
+}
 void MEM::wram_write(uint32_t address, uint8_t value)
 {
     wram[address & 0x3ffff] = value;
@@ -368,6 +508,13 @@ void MEM::arm_write_(uint32_t address, uint8_t offset, uint8_t value)
 void MEM::arm_writeb(uint32_t address, uint8_t value)
 {
     uint8_t ah = address >> 24;
+    if (ah < 4) {
+        uint8_t *ptr = page_write_ptr(address);
+        if (ptr) {
+            *ptr = value;
+            return;
+        }
+    }
     if (ah == 7)
         return;
     if (ah > 4 && ah < 8) {
@@ -379,13 +526,23 @@ void MEM::arm_writeb(uint32_t address, uint8_t value)
 }
 void MEM::arm_writeh(uint32_t address, uint16_t value)
 {
-    uint32_t a = address & ~1;
+    uint32_t a   = address & ~1;
+    uint8_t *ptr = page_write_ptr(a);
+    if (ptr) {
+        *(uint16_t *)ptr = value;
+        return;
+    }
     arm_write_(a | 0, 0, (uint8_t)(value >> 0));
     arm_write_(a | 1, 1, (uint8_t)(value >> 8));
 }
 void MEM::arm_write(uint32_t address, uint32_t value)
 {
-    uint32_t a = address & ~3;
+    uint32_t a   = address & ~3;
+    uint8_t *ptr = page_write_ptr(a);
+    if (ptr) {
+        *(uint32_t *)ptr = value;
+        return;
+    }
     arm_write_(a | 0, 0, (uint8_t)(value >> 0));
     arm_write_(a | 1, 1, (uint8_t)(value >> 8));
     arm_write_(a | 2, 2, (uint8_t)(value >> 16));
@@ -420,4 +577,11 @@ void MEM::arm_write_s(uint32_t address, uint32_t value)
 {
     arm_access_bus(address, ARM_WORD_SZ, SEQUENTIAL);
     arm_write(address, value);
+}
+uint32_t *MEM::arm_write_block(uint32_t address, uint8_t cnt)
+{
+    uint32_t *ptr = (uint32_t *)page_block_ptr(write_page, address, cnt * 4);
+    if (ptr)
+        arm_access_block(address, ARM_WORD_SZ, cnt);
+    return ptr;
 }
\ No newline at end of file
@@ -4,6 +4,27 @@
 #include <stdint.h>
 #include "gba.h"
 
+// Region sizes
+#define BIOS_SZ   0x4000
+#define WRAM_SZ   0x40000
+#define IWRAM_SZ  0x8000
+#define PRAM_SZ   0x400
+#define VRAM_SZ   0x18000
+#define OAM_SZ    0x400
+#define ROM_SZ    0x2000000
+#define EEPROM_SZ 0x2000
+#define SRAM_SZ   0x10000
+#define FLASH_SZ  0x20000
+
+// Fast path page table, covers 0x00000000-0x0fffffff in 32KB pages
+#define PAGE_SHIFT 15
+#define PAGE_COUNT (1 << (28 - PAGE_SHIFT))
+
+// Cached code tracking for WRAM and IWRAM in 256 byte lines, the IWRAM lines follow the WRAM ones
+#define CODE_LINE_SHIFT 8
+#define CODE_LINES      ((WRAM_SZ + IWRAM_SZ) >> CODE_LINE_SHIFT)
+#define CODE_LINE_NONE  0xffff
+
 typedef enum
 {
     NON_SEQ,
@@ -18,6 +39,13 @@ typedef enum
     BANK_SWITCH
 } flash_mode_e;
 
+typedef struct
+{
+    uint8_t *ptr;
+    uint32_t mask;
+    uint8_t *code;    // Code line flags of the page, only set for writable RAM
+} mem_page_t;
+
 
 class MEM {
   public:
@@ -50,11 +78,30 @@ class MEM {
 
     const uint8_t bus_size_lut[16] = {4, 4, 2, 4, 4, 2, 2, 4, 2, 2, 2, 2, 2, 2, 1, 1};
 
+    // Host pointers for plain memory, a null ptr means the access needs the slow path
+    mem_page_t read_page[PAGE_COUNT];
+    mem_page_t write_page[PAGE_COUNT];
+
+    // Lines some cached block was decoded from, and how often each one was overwritten since
+    uint8_t  code_line[CODE_LINES];
+    uint32_t code_gen[CODE_LINES];
+
   public:
     MEM(GBA *_gba);
 
+    void     page_set(mem_page_t *page, uint8_t *ptr, uint32_t mask);
+    void     page_map_init();
+    uint8_t *page_read_ptr(uint32_t address);
+    uint8_t *page_write_ptr(uint32_t address);
+    uint8_t *page_block_ptr(mem_page_t *page, uint32_t address, uint32_t len);
+
+    uint16_t code_line_idx(uint32_t address);
+    void     code_invalidate(uint8_t *line);
+    void     code_clear();
+
     void arm_access(uint32_t address, access_type_e at);
     void arm_access_bus(uint32_t address, uint8_t size, access_type_e at);
+    void arm_access_block(uint32_t address, uint8_t size, uint32_t cnt);
 
     uint8_t bios_read(uint32_t address);
     uint8_t wram_read(uint32_t address);
@@ -95,5 +142,9 @@ class MEM {
     void arm_writeb_s(uint32_t address, uint8_t value);
     void arm_writeh_s(uint32_t address, uint16_t value);
     void arm_write_s(uint32_t address, uint32_t value);
+
+    // LDM/STM transfers that fit in one mapped page, null when the per word path is needed
+    uint32_t *arm_read_block(uint32_t address, uint8_t cnt);
+    uint32_t *arm_write_block(uint32_t address, uint8_t cnt);
 };
 #endif
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+
+
+REWIND::REWIND(uint32_t _state_sz, uint32_t _ring_sz)
+{
+    state_sz = _state_sz;
+    words    = (state_sz + 3) / 4;
+    ring_sz  = _ring_sz;
+    head     = (uint32_t *)calloc(words, 4);
+    // Alternating single words encode to 3 words per 2, plus the final run header
+    comp     = (uint32_t *)malloc((words * 2 + 2) * 4);
+    ring     = (uint8_t *)malloc(ring_sz);
+    free_cnt = REWIND_SLOTS;
+    for (uint8_t i = 0; i < REWIND_SLOTS; i++) {
+        slot[i]      = (uint32_t *)calloc(words, 4);
+        slot_free[i] = i;
+    }
+    worker_thread = std::thread(&REWIND::worker, this);
+}
+REWIND::~REWIND()
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        quit = true;
+    }
+    work_cv.notify_all();
+    worker_thread.join();
+    for (uint8_t i = 0; i < REWIND_SLOTS; i++) {
+        free(slot[i]);
+    }
+    free(ring);
+    free(comp);
+    free(head);
+}
+uint32_t REWIND::rle_encode(const uint32_t *cur, const uint32_t *prev, uint32_t *out)
+{
+    uint32_t len = 0;
+    uint32_t i   = 0;
+    while (i < words) {
+        uint32_t zeros = 0;
+        while (i < words && cur[i] == prev[i]) {
+            zeros++;
+            i++;
+        }
+        uint32_t hdr  = len;
+        uint32_t lits = 0;
+        len += 2;
+        while (i < words && cur[i] != prev[i]) {
+            out[len++] = cur[i] ^ prev[i];
+            lits++;
+            i++;
+        }
+        out[hdr + 0] = zeros;
+        out[hdr + 1] = lits;
+    }
+    return len * 4;
+}
+void REWIND::rle_apply(const uint32_t *in, uint32_t len, uint32_t *state)
+{
+    uint32_t n = len / 4;
+    uint32_t p = 0;
+    uint32_t i = 0;
+    while (p < n) {
+        i += in[p++];
+        uint32_t lits = in[p++];
+        while (lits--) {
+            state[i++] ^= in[p++];
+        }
+    }
+}
+void REWIND::ring_store(const uint32_t *data, uint32_t len)
+{
+    if (len > ring_sz)
+        return;
+    // Entries still in the ring from the previous lap sit at or after the write position, oldest first
+    if (ring_wr + len > ring_sz) {
+        while (ent_cnt && ent[ent_first].off >= ring_wr) {
+            ent_first = (ent_first + 1) % REWIND_MAX_ENT;
+            ent_cnt--;
+        }
+        ring_wr = 0;
+    }
+    while (ent_cnt && ent[ent_first].off >= ring_wr && ent[ent_first].off < ring_wr + len) {
+        ent_first = (ent_first + 1) % REWIND_MAX_ENT;
+        ent_cnt--;
+    }
+    if (ent_cnt == REWIND_MAX_ENT) {
+        ent_first = (ent_first + 1) % REWIND_MAX_ENT;
+        ent_cnt--;
+    }
+    rewind_ent_t *e = &ent[(ent_first + ent_cnt++) % REWIND_MAX_ENT];
+    e->off          = ring_wr;
+    e->len          = len;
+    memcpy(ring + ring_wr, data, len);
+    ring_wr += len;
+}
+void REWIND::worker()
+{
+    while (true) {
+        uint8_t idx;
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            work_cv.wait(lk, [&] { return quit || queue_cnt; });
+            if (quit)
+                return;
+            idx = slot_queue[0];
+            memmove(slot_queue, slot_queue + 1, --queue_cnt);
+            busy = true;
+        }
+        // Only the worker touches head and the ring while busy is set
+        if (head_vld) {
+            uint32_t len = rle_encode(slot[idx], head, comp);
+            ring_store(comp, len);
+        }
+        memcpy(head, slot[idx], words * 4);
+        head_vld = true;
+
+        std::lock_guard<std::mutex> lk(lock);
+        slot_free[free_cnt++] = idx;
+        busy                  = false;
+        idle_cv.notify_all();
+    }
+}
+void REWIND::flush()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    idle_cv.wait(lk, [&] { return !queue_cnt && !busy; });
+}
+void REWIND::rewind_push(GBA *gba)
+{
+    uint8_t idx;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        if (!free_cnt) {
+            dropped++;
+            return;
+        }
+        idx = slot_free[--free_cnt];
+    }
+    gba->save_state((uint8_t *)slot[idx]);
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        slot_queue[queue_cnt++] = idx;
+    }
+    work_cv.notify_one();
+}
+bool REWIND::rewind_pop(GBA *gba, uint32_t steps)
+{
+    flush();
+    std::lock_guard<std::mutex> lk(lock);
+    if (!head_vld || !ent_cnt)
+        return false;
+    while (steps-- && ent_cnt) {
+        rewind_ent_t *e = &ent[(ent_first + --ent_cnt) % REWIND_MAX_ENT];
+        rle_apply((uint32_t *)(ring + e->off), e->len, head);
+        ring_wr = e->off;
+    }
+    return gba->load_state((uint8_t *)head, state_sz);
+}
+void REWIND::rewind_clear()
+{
+    flush();
+    std::lock_guard<std::mutex> lk(lock);
+    head_vld  = false;
+    ent_first = 0;
+    ent_cnt   = 0;
+    ring_wr   = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "gba.h"
+
+#define REWIND_RING_SZ (32 * 1024 * 1024)    // Compressed history
+#define REWIND_MAX_ENT (60 * 60 * 10)        // Frames of history, 10 minutes at 60fps
+#define REWIND_SLOTS   4                     // Raw states queued for the worker
+
+typedef struct
+{
+    uint32_t off;
+    uint32_t len;
+} rewind_ent_t;
+
+
+// Per-frame savestate history. Each entry is the XOR of a state with the one before it, run-length encoded
+// as (zero words, literal words, literals...) so unchanged memory costs almost nothing. The emulation thread
+// only copies the raw state into a free slot, the worker thread does the delta and compression.
+class REWIND {
+  public:
+    uint32_t state_sz;
+    uint32_t words;    // State size rounded up to whole words
+
+    uint32_t *head     = nullptr;    // Newest state the ring chains back from
+    bool      head_vld = false;
+    uint32_t *comp     = nullptr;    // Worker scratch, worst case encoding
+
+    uint8_t     *ring = nullptr;
+    uint32_t     ring_sz;
+    uint32_t     ring_wr = 0;
+    rewind_ent_t ent[REWIND_MAX_ENT];
+    uint32_t     ent_first = 0;
+    uint32_t     ent_cnt   = 0;
+
+    uint32_t *slot[REWIND_SLOTS];
+    uint8_t   slot_free[REWIND_SLOTS];
+    uint8_t   slot_queue[REWIND_SLOTS];
+    uint8_t   free_cnt;
+    uint8_t   queue_cnt = 0;
+    bool      busy      = false;
+    bool      quit      = false;
+    uint32_t  dropped   = 0;    // Frames skipped because every slot was queued
+
+    std::mutex              lock;
+    std::condition_variable work_cv;
+    std::condition_variable idle_cv;
+    std::thread             worker_thread;
+
+  public:
+    REWIND(uint32_t _state_sz, uint32_t _ring_sz);
+    ~REWIND();
+
+    uint32_t rle_encode(const uint32_t *cur, const uint32_t *prev, uint32_t *out);
+    void     rle_apply(const uint32_t *in, uint32_t len, uint32_t *state);
+    void     ring_store(const uint32_t *data, uint32_t len);
+    void     worker();
+    void     flush();
+
+    void rewind_push(GBA *gba);
+    bool rewind_pop(GBA *gba, uint32_t steps);
+    void rewind_clear();
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "runner.h"
+
+
+RUNNER::RUNNER(uint32_t threads)
+{
+    if (!threads)
+        threads = std::thread::hardware_concurrency();
+    worker_cnt = threads ? threads : 1;
+    for (uint32_t i = 0; i < worker_cnt; i++) {
+        workers.emplace_back(&RUNNER::worker, this);
+    }
+}
+RUNNER::~RUNNER()
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        quit = true;
+    }
+    work_cv.notify_all();
+    for (std::thread &t : workers) {
+        t.join();
+    }
+}
+void RUNNER::worker()
+{
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            work_cv.wait(lk, [&] { return quit || batch != seen; });
+            if (quit)
+                return;
+            seen = batch;
+        }
+        uint32_t idx;
+        while ((idx = job_next++) < job_cnt) {
+            for (uint32_t f = 0; f < job_frames; f++) {
+                jobs[idx]->run_frame();
+            }
+        }
+        std::lock_guard<std::mutex> lk(lock);
+        if (++job_done == worker_cnt)
+            done_cv.notify_one();
+    }
+}
+void RUNNER::run_frames(GBA **gbas, uint32_t count, uint32_t frames)
+{
+    std::unique_lock<std::mutex> lk(lock);
+    jobs       = gbas;
+    job_cnt    = count;
+    job_frames = frames;
+    job_next   = 0;
+    job_done   = 0;
+    batch++;
+    work_cv.notify_all();
+    done_cv.wait(lk, [&] { return job_done == worker_cnt; });
+}
@@ -0,0 +1,40 @@
+#ifndef _RUNNER_H_
+#define _RUNNER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gba.h"
+
+
+// Fixed pool of worker threads stepping independent GBA instances in parallel.
+// Each worker takes one whole instance at a time, so an instance never moves between threads mid-batch.
+class RUNNER {
+  public:
+    std::vector<std::thread> workers;
+    uint32_t                 worker_cnt;
+
+    std::mutex              lock;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    GBA                 **jobs       = nullptr;
+    uint32_t              job_cnt    = 0;
+    uint32_t              job_frames = 0;
+    std::atomic<uint32_t> job_next{0};
+    uint32_t              job_done = 0;    // Workers finished with the current batch
+    uint64_t              batch    = 0;
+    bool                  quit     = false;
+
+  public:
+    RUNNER(uint32_t threads);
+    ~RUNNER();
+
+    void worker();
+    void run_frames(GBA **gbas, uint32_t count, uint32_t frames);
+};
+
+#endif
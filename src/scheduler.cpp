@@ -0,0 +1,92 @@
+#include "arm.h"
+#include "io.h"
+#include "scheduler.h"
+#include "sound.h"
+#include "timer.h"
+
+
+SCHED::SCHED(GBA *_gba)
+{
+    gba = _gba;
+}
+void SCHED::sched_reset()
+{
+    uint8_t evt;
+    for (evt = 0; evt < EVT_COUNT; evt++) {
+        evt_enb[evt] = false;
+    }
+    now                    = 0;
+    next                   = UINT64_MAX;
+    gba->timer->tmr_cycles = 0;
+    gba->io->v_count.w     = 0;
+    gba->line_start(0);
+    sched_add(EVT_SOUND, SAMP_CYCLES);
+}
+uint64_t SCHED::sched_cycles()
+{
+    return now + gba->cpu->arm_cycles;
+}
+void SCHED::sched_add(sched_evt_e evt, uint64_t when)
+{
+    evt_when[evt] = when;
+    evt_enb[evt]  = true;
+    sched_next();
+    // Events added while the CPU is running shorten the current slice
+    if (next - now < gba->cpu->arm_target)
+        gba->cpu->arm_target = next - now;
+}
+void SCHED::sched_del(sched_evt_e evt)
+{
+    evt_enb[evt] = false;
+    sched_next();
+}
+void SCHED::sched_next()
+{
+    uint8_t evt;
+    next = UINT64_MAX;
+    for (evt = 0; evt < EVT_COUNT; evt++) {
+        if (evt_enb[evt] && evt_when[evt] < next)
+            next = evt_when[evt];
+    }
+}
+void SCHED::sched_dispatch(sched_evt_e evt, uint64_t when)
+{
+    switch (evt) {
+        case EVT_HDRAW:
+            gba->line_next(when);
+            break;
+        case EVT_HBLANK:
+            gba->line_hblank();
+            break;
+        case EVT_TIMER:
+            gba->timer->timers_sync();
+            break;
+        case EVT_SOUND: {
+            uint64_t start = gba->phase_now();
+            gba->sound->sound_clock(SAMP_CYCLES);
+            gba->phase_add(PHASE_SOUND, start);
+            sched_add(EVT_SOUND, when + SAMP_CYCLES);
+            break;
+        }
+        default:
+            break;
+    }
+}
+void SCHED::sched_run()
+{
+    uint64_t start = gba->phase_now();
+    gba->cpu->arm_exec(next - now);
+    gba->phase_add(PHASE_CPU, start);
+    now += gba->cpu->arm_target;
+    while (next <= sched_cycles()) {
+        uint8_t evt;
+        uint8_t first = EVT_COUNT;
+        for (evt = 0; evt < EVT_COUNT; evt++) {
+            if (evt_enb[evt] && (first == EVT_COUNT || evt_when[evt] < evt_when[first]))
+                first = evt;
+        }
+        evt_enb[first] = false;
+        sched_next();
+        sched_dispatch((sched_evt_e)first, evt_when[first]);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gba.h"
+
+typedef enum
+{
+    EVT_HDRAW  = 0,    // Start of a scanline
+    EVT_HBLANK = 1,    // Start of the HBlank period
+    EVT_TIMER  = 2,    // Earliest overflow of a running timer
+    EVT_SOUND  = 3,    // Output sample tick
+    EVT_COUNT  = 4
+} sched_evt_e;
+
+
+// Timestamp ordered event scheduler, the CPU runs uninterrupted until the next pending event.
+// There are only a handful of event kinds, so each one has a fixed slot instead of a heap.
+class SCHED {
+  public:
+    GBA *gba = nullptr;
+
+    uint64_t now;     // Cycle count at the start of the current CPU slice
+    uint64_t next;    // Earliest pending event
+    uint64_t evt_when[EVT_COUNT];
+    bool     evt_enb[EVT_COUNT];
+
+  public:
+    SCHED(GBA *_gba);
+
+    void     sched_reset();
+    uint64_t sched_cycles();
+    void     sched_add(sched_evt_e evt, uint64_t when);
+    void     sched_del(sched_evt_e evt);
+    void     sched_next();
+    void     sched_dispatch(sched_evt_e evt, uint64_t when);
+    void     sched_run();
+};
+
+#endif
@@ -1,127 +1,51 @@
 #include <stdint.h>
+#include <string.h>
 #include "io.h"
 #include "sound.h"
 
-#define PSG_MAX     0x7f
-#define PSG_MIN     -0x80
-#define SAMP_MAX    0x1ff
-#define SAMP_MIN    -0x200
-#define SAMPLE_TIME (1.0 / (SND_FREQUENCY))
+#define PSG_MAX  0x7f
+#define PSG_MIN  -0x80
+#define SAMP_MAX 0x1ff
+#define SAMP_MIN -0x200
 
 
 SOUND::SOUND(GBA *_gba)
 {
     gba = _gba;
 }
+void SOUND::sound_reset()
+{
+    fifo_a_len     = 0;
+    fifo_b_len     = 0;
+    fifo_a_samp    = 0;
+    fifo_b_samp    = 0;
+    snd_cycles     = 0;
+    wave_position  = 0;
+    wave_samples   = 0;
+    psg_seq_cycles = 0;
+    psg_seq_step   = 0;
+    memset(snd_ch_state, 0, sizeof(snd_ch_state));
+    // A channel enabled without a trigger must not step with a zero period
+    for (uint8_t ch = 0; ch < 4; ch++)
+        psg_period(ch);
+}
 int8_t SOUND::square_sample(uint8_t ch)
 {
     if (!(gba->io->snd_psg_enb.w & (CH_SQR1 << ch)))
         return 0;
-    uint8_t  sweep_time = (gba->io->sqr_ch[ch].sweep.w >> 4) & 0x7;
-    uint8_t  duty       = (gba->io->sqr_ch[ch].tone.w >> 6) & 0x3;
-    uint8_t  env_step   = (gba->io->sqr_ch[ch].tone.w >> 8) & 0x7;
-    uint8_t  envelope   = (gba->io->sqr_ch[ch].tone.w >> 12) & 0xf;
-    uint8_t  snd_len    = (gba->io->sqr_ch[ch].tone.w >> 0) & 0x3f;
-    uint16_t freq_hz    = (gba->io->sqr_ch[ch].ctrl.w >> 0) & 0x7ff;
-
-    double frequency         = 131072.0 / (2048 - freq_hz);
-    double length            = (64 - snd_len) / 256.0;
-    double sweep_interval    = 0.0078 * (sweep_time + 1);
-    double envelope_interval = env_step / 64.0;
-    double cycle_samples     = SND_FREQUENCY / frequency;
-
-    if (gba->io->sqr_ch[ch].ctrl.w & CH_LEN) {
-        snd_ch_state[ch].length_time += SAMPLE_TIME;
-        if (snd_ch_state[ch].length_time >= length) {
-
-            gba->io->snd_psg_enb.w &= ~(CH_SQR1 << ch);
-
-            return 0;
-        }
-    }
-
-    if (ch == 0) {
-        snd_ch_state[0].sweep_time += SAMPLE_TIME;
-        if (snd_ch_state[0].sweep_time >= sweep_interval) {
-            snd_ch_state[0].sweep_time -= sweep_interval;
-
-            uint8_t sweep_shift = gba->io->sqr_ch[0].sweep.w & 7;
-            if (sweep_shift) {
-                uint32_t disp = freq_hz >> sweep_shift;
-                if (gba->io->sqr_ch[0].sweep.w & SWEEP_DEC)
-                    freq_hz -= disp;
-                else
-                    freq_hz += disp;
-                if (freq_hz < 0x7ff) {
-
-                    gba->io->sqr_ch[0].ctrl.w &= ~0x7ff;
-                    gba->io->sqr_ch[0].ctrl.w |= freq_hz;
-                } else {
-
-                    gba->io->snd_psg_enb.w &= ~CH_SQR1;
-                }
-            }
-        }
-    }
-
-    if (env_step) {
-        snd_ch_state[ch].env_time += SAMPLE_TIME;
-        if (snd_ch_state[ch].env_time >= envelope_interval) {
-            snd_ch_state[ch].env_time -= envelope_interval;
-            if (gba->io->sqr_ch[ch].tone.w & ENV_INC) {
-                if (envelope < 0xf)
-                    envelope++;
-            } else {
-                if (envelope > 0x0)
-                    envelope--;
-            }
-            gba->io->sqr_ch[ch].tone.w &= ~0xf000;
-            gba->io->sqr_ch[ch].tone.w |= envelope << 12;
-        }
-    }
-
-    snd_ch_state[ch].samples++;
-    if (snd_ch_state[ch].phase) {
-
-        double phase_change = cycle_samples * duty_lut[duty];
-        if (snd_ch_state[ch].samples > phase_change) {
-            snd_ch_state[ch].samples -= phase_change;
-            snd_ch_state[ch].phase = false;
-        }
-    } else {
+    snd_ch_state_t *st   = &snd_ch_state[ch];
+    uint8_t         duty = (gba->io->sqr_ch[ch].tone.w >> 6) & 0x3;
 
-        double phase_change = cycle_samples * duty_lut_i[duty];
-        if (snd_ch_state[ch].samples > phase_change) {
-            snd_ch_state[ch].samples -= phase_change;
-            snd_ch_state[ch].phase = true;
-        }
-    }
-    return snd_ch_state[ch].phase ? (envelope / 15.0) * PSG_MAX : (envelope / 15.0) * PSG_MIN;
+    st->duty_pos = (st->duty_pos + psg_steps(ch)) & 7;
+    return st->duty_pos >= psg_duty_lut[duty] ? st->volume * PSG_MAX / 15 : st->volume * PSG_MIN / 15;
 }
 int8_t SOUND::wave_sample()
 {
     if (!((gba->io->snd_psg_enb.w & CH_WAVE) && (gba->io->wave_ch.wave.w & WAVE_PLAY)))
         return 0;
-    uint8_t  snd_len = (gba->io->wave_ch.volume.w >> 0) & 0xff;
-    uint8_t  volume  = (gba->io->wave_ch.volume.w >> 13) & 0x7;
-    uint16_t freq_hz = (gba->io->wave_ch.ctrl.w >> 0) & 0x7ff;
-
-    double frequency     = 2097152.0 / (2048 - freq_hz);
-    double length        = (256 - snd_len) / 256.0;
-    double cycle_samples = SND_FREQUENCY / frequency;
+    uint8_t volume = (gba->io->wave_ch.volume.w >> 13) & 0x7;
 
-    if (gba->io->wave_ch.ctrl.w & CH_LEN) {
-        snd_ch_state[2].length_time += SAMPLE_TIME;
-        if (snd_ch_state[2].length_time >= length) {
-
-            gba->io->snd_psg_enb.w &= ~CH_WAVE;
-
-            return 0;
-        }
-    }
-    snd_ch_state[2].samples++;
-    if (snd_ch_state[2].samples >= cycle_samples) {
-        snd_ch_state[2].samples -= cycle_samples;
+    for (uint8_t steps = psg_steps(2); steps; steps--) {
         if (--wave_samples)
             wave_position = (wave_position + 1) & 0x3f;
         else
@@ -146,60 +70,154 @@ int8_t SOUND::wave_sample()
             samp = (samp >> 2) * 3;
             break;
     }
-    return samp >= 0 ? (samp / 7.0) * PSG_MAX : (samp / -8.0) * PSG_MIN;
+    return samp >= 0 ? samp * PSG_MAX / 7 : samp * PSG_MIN / -8;
 }
 int8_t SOUND::noise_sample()
 {
     if (!(gba->io->snd_psg_enb.w & CH_NOISE))
         return 0;
-    uint8_t env_step = (gba->io->noise_ch.env.w >> 8) & 0x7;
-    uint8_t envelope = (gba->io->noise_ch.env.w >> 12) & 0xf;
-    uint8_t snd_len  = (gba->io->noise_ch.env.w >> 0) & 0x3f;
-    uint8_t freq_div = (gba->io->noise_ch.ctrl.w >> 0) & 0x7;
-    uint8_t freq_rsh = (gba->io->noise_ch.ctrl.w >> 4) & 0xf;
+    snd_ch_state_t *st    = &snd_ch_state[3];
+    uint8_t         carry = st->lfsr & 1;
+    uint8_t         tap   = gba->io->noise_ch.ctrl.w & NOISE_7 ? 6 : 14;
 
-    double frequency         = freq_div ? (524288 / freq_div) >> (freq_rsh + 1) : (524288 * 2) >> (freq_rsh + 1);
-    double length            = (64 - snd_len) / 256.0;
-    double envelope_interval = env_step / 64.0;
-    double cycle_samples     = SND_FREQUENCY / frequency;
-
-    if (gba->io->noise_ch.ctrl.w & CH_LEN) {
-        snd_ch_state[3].length_time += SAMPLE_TIME;
-        if (snd_ch_state[3].length_time >= length) {
+    for (uint8_t steps = psg_steps(3); steps; steps--) {
+        uint8_t high = (st->lfsr ^ (st->lfsr >> 1)) & 1;
+        st->lfsr     = (st->lfsr >> 1) | (high << tap);
+    }
+    return carry ? st->volume * PSG_MAX / 15 : st->volume * PSG_MIN / 15;
+}
+uint8_t SOUND::psg_steps(uint8_t ch)
+{
+    // Waveform steps within the next output sample, the period never drops below 8 cycles
+    snd_ch_state_t *st    = &snd_ch_state[ch];
+    uint8_t         steps = 0;
+    st->timer -= SAMP_CYCLES;
+    while (st->timer <= 0) {
+        st->timer += st->period;
+        steps++;
+    }
+    return steps;
+}
+void SOUND::psg_period(uint8_t ch)
+{
+    IO      *io = gba->io;
+    uint32_t period;
+    if (ch < 2) {
+        // 131072 / (2048 - f) Hz over 8 duty steps
+        period = (2048 - (io->sqr_ch[ch].ctrl.w & 0x7ff)) * 16;
+    } else if (ch == 2) {
+        // 2097152 / (2048 - f) Hz per wave RAM sample
+        period = (2048 - (io->wave_ch.ctrl.w & 0x7ff)) * 8;
+    } else {
+        // 524288 / r / 2^(s+1) Hz, with r = 0 counting as 0.5
+        uint8_t freq_div = (io->noise_ch.ctrl.w >> 0) & 0x7;
+        uint8_t freq_rsh = (io->noise_ch.ctrl.w >> 4) & 0xf;
+        period           = (freq_div ? freq_div * 32 : 16) << (freq_rsh + 1);
+    }
+    snd_ch_state[ch].period = period;
+}
+void SOUND::psg_length(uint8_t ch)
+{
+    IO *io = gba->io;
+    if (ch < 2)
+        snd_ch_state[ch].length = 64 - (io->sqr_ch[ch].tone.w & 0x3f);
+    else if (ch == 2)
+        snd_ch_state[ch].length = 256 - (io->wave_ch.volume.w & 0xff);
+    else
+        snd_ch_state[ch].length = 64 - (io->noise_ch.env.w & 0x3f);
+}
+void SOUND::psg_trigger(uint8_t ch)
+{
+    IO             *io  = gba->io;
+    snd_ch_state_t *st  = &snd_ch_state[ch];
+    uint16_t        env = 0;
+    psg_period(ch);
+    psg_length(ch);
+    st->timer    = st->period;
+    st->duty_pos = 0;
+    if (ch < 2) {
+        env = io->sqr_ch[ch].tone.w;
+    } else if (ch == 2) {
+        wave_reset();
+    } else {
+        env      = io->noise_ch.env.w;
+        st->lfsr = io->noise_ch.ctrl.w & NOISE_7 ? 0x007f : 0x7fff;
+    }
+    st->volume      = (env >> 12) & 0xf;
+    st->env_ticks   = (env >> 8) & 0x7;
+    st->sweep_ticks = (io->sqr_ch[0].sweep.w >> 4) & 0x7;
+}
+void SOUND::psg_envelope(uint8_t ch, uint16_t env)
+{
+    snd_ch_state_t *st       = &snd_ch_state[ch];
+    uint8_t         env_step = (env >> 8) & 0x7;
+    if (!env_step || (st->env_ticks && --st->env_ticks))
+        return;
+    st->env_ticks = env_step;
+    if (env & ENV_INC) {
+        if (st->volume < 0xf)
+            st->volume++;
+    } else {
+        if (st->volume > 0x0)
+            st->volume--;
+    }
+}
+void SOUND::psg_sweep()
+{
+    IO             *io          = gba->io;
+    snd_ch_state_t *st          = &snd_ch_state[0];
+    uint8_t         sweep_time  = (io->sqr_ch[0].sweep.w >> 4) & 0x7;
+    uint8_t         sweep_shift = (io->sqr_ch[0].sweep.w >> 0) & 0x7;
+    if (!sweep_time || (st->sweep_ticks && --st->sweep_ticks))
+        return;
+    st->sweep_ticks = sweep_time;
+    if (!sweep_shift)
+        return;
+    uint16_t freq_hz = io->sqr_ch[0].ctrl.w & 0x7ff;
+    uint16_t disp    = freq_hz >> sweep_shift;
+    if (io->sqr_ch[0].sweep.w & SWEEP_DEC)
+        freq_hz -= disp;
+    else
+        freq_hz += disp;
+    if (freq_hz <= 0x7ff) {
 
-            gba->io->snd_psg_enb.w &= ~CH_NOISE;
+        io->sqr_ch[0].ctrl.w &= ~0x7ff;
+        io->sqr_ch[0].ctrl.w |= freq_hz;
+        psg_period(0);
+    } else {
 
-            return 0;
-        }
+        io->snd_psg_enb.w &= ~CH_SQR1;
     }
+}
+void SOUND::psg_seq_clock()
+{
+    IO *io = gba->io;
+    psg_seq_cycles += SAMP_CYCLES;
+    if (psg_seq_cycles < PSG_SEQ_CYCLES)
+        return;
+    psg_seq_cycles -= PSG_SEQ_CYCLES;
+    psg_seq_step = (psg_seq_step + 1) & 7;
 
-    if (env_step) {
-        snd_ch_state[3].env_time += SAMPLE_TIME;
-        if (snd_ch_state[3].env_time >= envelope_interval) {
-            snd_ch_state[3].env_time -= envelope_interval;
-            if (gba->io->noise_ch.env.w & ENV_INC) {
-                if (envelope < 0xf)
-                    envelope++;
-            } else {
-                if (envelope > 0x0)
-                    envelope--;
-            }
-            gba->io->noise_ch.env.w &= ~0xf000;
-            gba->io->noise_ch.env.w |= envelope << 12;
+    // Length on even steps, sweep on steps 2 and 6, envelope on step 7
+    if (!(psg_seq_step & 1)) {
+        uint32_t ctrl[4] = {io->sqr_ch[0].ctrl.w, io->sqr_ch[1].ctrl.w, io->wave_ch.ctrl.w, io->noise_ch.ctrl.w};
+        for (uint8_t ch = 0; ch < 4; ch++) {
+            if (!(io->snd_psg_enb.w & (1 << ch)) || !(ctrl[ch] & CH_LEN) || !snd_ch_state[ch].length)
+                continue;
+            if (!--snd_ch_state[ch].length)
+                io->snd_psg_enb.w &= ~(1 << ch);
         }
     }
-    uint8_t carry = snd_ch_state[3].lfsr & 1;
-    snd_ch_state[3].samples++;
-    if (snd_ch_state[3].samples >= cycle_samples) {
-        snd_ch_state[3].samples -= cycle_samples;
-        snd_ch_state[3].lfsr >>= 1;
-        uint8_t high = (snd_ch_state[3].lfsr & 1) ^ carry;
-        if (gba->io->noise_ch.ctrl.w & NOISE_7)
-            snd_ch_state[3].lfsr |= (high << 6);
-        else
-            snd_ch_state[3].lfsr |= (high << 14);
+    if ((psg_seq_step & 3) == 2 && (io->snd_psg_enb.w & CH_SQR1))
+        psg_sweep();
+    if (psg_seq_step == 7) {
+        if (io->snd_psg_enb.w & CH_SQR1)
+            psg_envelope(0, io->sqr_ch[0].tone.w);
+        if (io->snd_psg_enb.w & CH_SQR2)
+            psg_envelope(1, io->sqr_ch[1].tone.w);
+        if (io->snd_psg_enb.w & CH_NOISE)
+            psg_envelope(3, io->noise_ch.env.w);
     }
-    return carry ? (envelope / 15.0) * PSG_MAX : (envelope / 15.0) * PSG_MIN;
 }
 void SOUND::wave_reset()
 {
@@ -213,22 +231,25 @@ void SOUND::wave_reset()
         wave_samples  = 32;
     }
 }
-void SOUND::sound_buffer_wrap()
-{
-    if ((snd_cur_play / BUFF_SAMPLES) == (snd_cur_write / BUFF_SAMPLES)) {
-        snd_cur_play &= BUFF_SAMPLES_MSK;
-        snd_cur_write &= BUFF_SAMPLES_MSK;
-    }
-}
 void SOUND::sound_mix(void *data, uint8_t *stream, int32_t len)
 {
-    uint16_t i;
-    for (i = 0; i < len; i += 4) {
-        *(int16_t *)(stream + (i | 0)) = snd_buffer[snd_cur_play++ & BUFF_SAMPLES_MSK] << 6;
-        *(int16_t *)(stream + (i | 2)) = snd_buffer[snd_cur_play++ & BUFF_SAMPLES_MSK] << 6;
+    int16_t *out  = (int16_t *)stream;
+    uint32_t want = len / sizeof(int16_t);
+    uint32_t play = snd_cur_play.load(std::memory_order_relaxed);
+    uint32_t cnt  = snd_cur_write.load(std::memory_order_acquire) - play;
+    uint32_t i;
+    if (cnt < want)
+        snd_underruns.fetch_add(1, std::memory_order_relaxed);
+    else
+        cnt = want;
+    for (i = 0; i < cnt; i++) {
+        out[i] = snd_buffer[(play + i) & BUFF_SAMPLES_MSK] << 6;
     }
-
-    snd_cur_play += ((int32_t)(snd_cur_write - snd_cur_play) >> 8) & ~1;
+    // Whatever the emulation did not produce in time plays as silence
+    for (; i < want; i++) {
+        out[i] = 0;
+    }
+    snd_cur_play.store(play + cnt, std::memory_order_release);
 }
 void SOUND::fifo_a_copy()
 {
@@ -294,6 +315,7 @@ void SOUND::sound_clock(uint32_t cycles)
     if (gba->io->snd_pcm_vol.w & CH_DMAB_R)
         samp_pcm_r = clip(samp_pcm_r + samp_ch5);
     while (snd_cycles >= SAMP_CYCLES) {
+        psg_seq_clock();
         int16_t samp_ch0   = square_sample(0);
         int16_t samp_ch1   = square_sample(1);
         int16_t samp_ch2   = wave_sample();
@@ -320,8 +342,15 @@ void SOUND::sound_clock(uint32_t cycles)
         samp_psg_r *= psg_vol_lut[(gba->io->snd_psg_vol.w >> 0) & 7];
         samp_psg_l >>= psg_rsh_lut[(gba->io->snd_pcm_vol.w >> 0) & 3];
         samp_psg_r >>= psg_rsh_lut[(gba->io->snd_pcm_vol.w >> 0) & 3];
-        snd_buffer[snd_cur_write++ & BUFF_SAMPLES_MSK] = clip(samp_psg_l + samp_pcm_l);
-        snd_buffer[snd_cur_write++ & BUFF_SAMPLES_MSK] = clip(samp_psg_r + samp_pcm_r);
+        // A full ring drops the pair, that also bounds the latency when the emulation runs ahead of the output
+        uint32_t write = snd_cur_write.load(std::memory_order_relaxed);
+        if (write - snd_cur_play.load(std::memory_order_acquire) > SND_MAX_QUEUED - SND_CHANNELS) {
+            snd_overruns.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            snd_buffer[(write + 0) & BUFF_SAMPLES_MSK] = clip(samp_psg_l + samp_pcm_l);
+            snd_buffer[(write + 1) & BUFF_SAMPLES_MSK] = clip(samp_psg_r + samp_pcm_r);
+            snd_cur_write.store(write + SND_CHANNELS, std::memory_order_release);
+        }
         snd_cycles -= SAMP_CYCLES;
     }
 }
\ No newline at end of file
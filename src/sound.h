@@ -2,6 +2,7 @@
 #define _SOUND_H_
 #include <stdbool.h>
 #include <stdint.h>
+#include <atomic>
 #include "gba.h"
 
 #define CPU_FREQ_HZ      16777216
@@ -11,15 +12,22 @@
 #define SAMP_CYCLES      (CPU_FREQ_HZ / SND_FREQUENCY)
 #define BUFF_SAMPLES     ((SND_SAMPLES)*16 * 2)
 #define BUFF_SAMPLES_MSK ((BUFF_SAMPLES)-1)
+#define SND_PREFILL      0x200                               // Silent samples queued ahead of the first callback
+#define SND_MAX_QUEUED   ((SND_SAMPLES)*SND_CHANNELS * 4)    // Samples the ring holds before new ones are dropped
+#define SND_CACHE_LINE   64
+#define PSG_SEQ_CYCLES   (CPU_FREQ_HZ / 512)    // Frame sequencer step, length at 256 Hz, sweep 128 Hz, envelope 64 Hz
 
+// PSG channel counters, all integer and clocked in CPU cycles so the output does not depend on the host
 typedef struct
 {
-    bool     phase;          // Square 1/2 only
+    int32_t  timer;          // All, cycles left until the next waveform step
+    uint32_t period;         // All, cycles per waveform step, set from the frequency registers
+    uint16_t length;         // All, frame sequencer ticks until the channel stops
     uint16_t lfsr;           // Noise only
-    double   samples;        // All
-    double   length_time;    // All
-    double   sweep_time;     // Square 1 only
-    double   env_time;       // All except Wave
+    uint8_t  duty_pos;       // Square 1/2 only
+    uint8_t  volume;         // All except Wave
+    uint8_t  env_ticks;      // All except Wave
+    uint8_t  sweep_ticks;    // Square 1 only
 } snd_ch_state_t;
 
 class SOUND {
@@ -31,9 +39,6 @@ class SOUND {
     uint8_t fifo_a_len;
     uint8_t fifo_b_len;
 
-    int16_t  snd_buffer[BUFF_SAMPLES];
-    uint32_t snd_cur_play  = 0;
-    uint32_t snd_cur_write = 0x200;
     int8_t   fifo_a_samp;
     int8_t   fifo_b_samp;
     uint32_t snd_cycles = 0;
@@ -41,10 +46,21 @@ class SOUND {
     uint8_t wave_position;
     uint8_t wave_samples;
 
+    uint32_t psg_seq_cycles = 0;
+    uint8_t  psg_seq_step   = 0;
+
     snd_ch_state_t snd_ch_state[4];
 
-    double duty_lut[4]   = {0.125, 0.250, 0.500, 0.750};
-    double duty_lut_i[4] = {0.875, 0.750, 0.500, 0.250};
+    // Single producer, single consumer sample ring. The indices run freely and each side only stores its own,
+    // the emulation thread snd_cur_write and the audio callback snd_cur_play.
+    int16_t *snd_buffer = nullptr;    // Owned by the caller of GBA::init
+
+    alignas(SND_CACHE_LINE) std::atomic<uint32_t> snd_cur_write{SND_PREFILL};
+    std::atomic<uint32_t>                         snd_overruns{0};    // Sample pairs dropped on a full ring
+    alignas(SND_CACHE_LINE) std::atomic<uint32_t> snd_cur_play{0};
+    std::atomic<uint32_t>                         snd_underruns{0};    // Callbacks that ran out of samples
+
+    uint8_t psg_duty_lut[4] = {7, 6, 4, 2};    // First high step of the 8 step duty cycle
 
     int32_t psg_vol_lut[8] = {0x000, 0x024, 0x049, 0x06d, 0x092, 0x0b6, 0x0db, 0x100};
     int32_t psg_rsh_lut[4] = {0xa, 0x9, 0x8, 0x7};
@@ -52,11 +68,19 @@ class SOUND {
   public:
     SOUND(GBA *_gba);
 
+    void    sound_reset();
+
     int8_t  square_sample(uint8_t ch);
     int8_t  wave_sample();
     int8_t  noise_sample();
     void    wave_reset();
-    void    sound_buffer_wrap();
+    void    psg_period(uint8_t ch);
+    void    psg_length(uint8_t ch);
+    void    psg_trigger(uint8_t ch);
+    void    psg_envelope(uint8_t ch, uint16_t env);
+    void    psg_sweep();
+    void    psg_seq_clock();
+    uint8_t psg_steps(uint8_t ch);
     void    sound_mix(void *data, uint8_t *stream, int32_t len);
     void    fifo_a_copy();
     void    fifo_b_copy();
@@ -66,7 +90,6 @@ class SOUND {
     void    sound_clock(uint32_t cycles);
 };
 // void wave_reset();
-// void sound_buffer_wrap();
 // void sound_mix(void *data, uint8_t *stream, int32_t len);
 // void sound_clock(uint32_t cycles);
 // void fifo_a_copy();
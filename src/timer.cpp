@@ -1,6 +1,7 @@
 #include "arm.h"
 #include "dma.h"
 #include "io.h"
+#include "scheduler.h"
 #include "sound.h"
 #include "timer.h"
 
@@ -9,26 +10,59 @@ TIMER::TIMER(GBA *_gba)
 {
     gba = _gba;
 }
+void TIMER::timers_sync()
+{
+    uint64_t now    = gba->sched->sched_cycles();
+    uint32_t cycles = now - tmr_cycles;
+    tmr_cycles      = now;
+    if (tmr_enb)
+        timers_clock(cycles);
+    timers_schedule();
+}
+void TIMER::timers_schedule()
+{
+    uint8_t  idx;
+    uint64_t next = UINT64_MAX;
+    for (idx = 0; idx < 4; idx++) {
+        if (!(gba->io->tmr[idx].ctrl.w & TMR_ENB) || (gba->io->tmr[idx].ctrl.w & TMR_CASCADE))
+            continue;
+        uint8_t  shift = pscale_shift_lut[gba->io->tmr[idx].ctrl.w & 3];
+        uint64_t when  = tmr_cycles + ((uint64_t)(0x10000 - gba->io->tmr[idx].count.w) << shift) - tmr_icnt[idx];
+        if (when < next)
+            next = when;
+    }
+    if (next != UINT64_MAX)
+        gba->sched->sched_add(EVT_TIMER, next);
+    else
+        gba->sched->sched_del(EVT_TIMER);
+}
 void TIMER::timers_clock(uint32_t cycles)
 {
-    uint8_t idx;
-    bool    overflow = false;
+    uint8_t  idx;
+    uint32_t overflow = 0;
     for (idx = 0; idx < 4; idx++) {
         if (!(gba->io->tmr[idx].ctrl.w & TMR_ENB)) {
-            overflow = false;
+            overflow = 0;
             continue;
         }
         if (gba->io->tmr[idx].ctrl.w & TMR_CASCADE) {
-            if (overflow)
-                gba->io->tmr[idx].count.w++;
+            gba->io->tmr[idx].count.w += overflow;
         } else {
             uint8_t  shift = pscale_shift_lut[gba->io->tmr[idx].ctrl.w & 3];
             uint32_t inc   = (tmr_icnt[idx] += cycles) >> shift;
             gba->io->tmr[idx].count.w += inc;
             tmr_icnt[idx] -= inc << shift;
         }
-        if ((overflow = (gba->io->tmr[idx].count.w > 0xffff))) {
-            gba->io->tmr[idx].count.w = gba->io->tmr[idx].reload.w + (gba->io->tmr[idx].count.w - 0x10000);
+        overflow = 0;
+        if (gba->io->tmr[idx].count.w > 0xffff) {
+            // A lazy sync can cover several overflows
+            uint32_t period           = 0x10000 - gba->io->tmr[idx].reload.w;
+            uint32_t excess           = gba->io->tmr[idx].count.w - 0x10000;
+            overflow                  = 1 + excess / period;
+            gba->io->tmr[idx].count.w = gba->io->tmr[idx].reload.w + excess % period;
+        }
+        uint32_t i;
+        for (i = 0; i < overflow; i++) {
             if (((gba->io->snd_pcm_vol.w >> 10) & 1) == idx) {
                 gba->sound->fifo_a_load();
                 if (gba->sound->fifo_a_len <= 0x10)
@@ -43,4 +77,4 @@ void TIMER::timers_clock(uint32_t cycles)
         if ((gba->io->tmr[idx].ctrl.w & TMR_IRQ) && overflow)
             gba->io->trigger_irq(TMR0_FLAG << idx);
     }
-}
\ No newline at end of file
+}
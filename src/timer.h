@@ -16,10 +16,13 @@ class TIMER {
 
     uint32_t tmr_icnt[4];
     uint8_t  tmr_enb;
+    uint64_t tmr_cycles = 0;    // Scheduler cycle count of the last sync
 
   public:
     TIMER(GBA *_gba);
 
+    void timers_sync();
+    void timers_schedule();
     void timers_clock(uint32_t cycles);
 };
 
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include "trace.h"
+
+#define TRACE_WAKE_MS 10    // Writer poll interval between chunk notifications
+
+
+TRACE::TRACE()
+{
+    ring = (trace_ent_t *)malloc(sizeof(trace_ent_t) * TRACE_RING_SZ);
+}
+TRACE::~TRACE()
+{
+    trace_close();
+    free(ring);
+}
+void TRACE::trace_wait(uint64_t pos)
+{
+    // Only reached with a file open, the writer frees space a chunk at a time
+    while (pos - (tail_seen = tail.load(std::memory_order_acquire)) >= TRACE_RING_SZ) {
+        work_cv.notify_one();
+        std::this_thread::yield();
+    }
+}
+void TRACE::trace_dump(FILE *out, uint32_t cnt)
+{
+    uint64_t end = head.load(std::memory_order_relaxed);
+    uint64_t pos = end - std::min({(uint64_t)cnt, end, (uint64_t)TRACE_RING_SZ});
+    for (; pos < end; pos++) {
+        trace_ent_t *ent = &ring[pos & TRACE_RING_MSK];
+        if (ent->pc & 1)
+            fprintf(out, "%10u  %08x  %04x      cpsr %08x\n", ent->cycles, ent->pc & ~1, ent->op, ent->cpsr);
+        else
+            fprintf(out, "%10u  %08x  %08x  cpsr %08x\n", ent->cycles, ent->pc, ent->op, ent->cpsr);
+    }
+}
+bool TRACE::trace_open(const char *path)
+{
+    trace_close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    // The file starts with the next recorded instruction
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    tail.store(pos, std::memory_order_relaxed);
+    tail_seen     = pos;
+    quit          = false;
+    writer_thread = std::thread(&TRACE::writer, this);
+    return true;
+}
+void TRACE::trace_close()
+{
+    if (!file)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        quit = true;
+    }
+    work_cv.notify_all();
+    writer_thread.join();
+    fclose(file);
+    file = nullptr;
+}
+void TRACE::writer()
+{
+    while (true) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        uint64_t end = head.load(std::memory_order_acquire);
+        if (pos == end) {
+            // Everything recorded before quit was set is in the file by now
+            std::unique_lock<std::mutex> lk(lock);
+            if (quit)
+                return;
+            work_cv.wait_for(lk, std::chrono::milliseconds(TRACE_WAKE_MS));
+            continue;
+        }
+        uint64_t cnt = std::min(end - pos, (uint64_t)(TRACE_RING_SZ - (pos & TRACE_RING_MSK)));
+        fwrite(&ring[pos & TRACE_RING_MSK], sizeof(trace_ent_t), cnt, file);
+        tail.store(pos + cnt, std::memory_order_release);
+    }
+}
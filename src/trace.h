@@ -0,0 +1,66 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define TRACE_RING_SZ  (1 << 20)    // Entries, a power of two
+#define TRACE_RING_MSK (TRACE_RING_SZ - 1)
+#define TRACE_CHUNK    (1 << 14)    // Entries between writer wake-ups
+#define TRACE_DUMP_CNT 64           // Entries printed on an undefined instruction or a frontend dump
+
+typedef struct
+{
+    uint32_t pc;        // Bit 0 set for Thumb
+    uint32_t op;
+    uint32_t cpsr;
+    uint32_t cycles;    // Low half of the scheduler cycle count before the instruction
+} trace_ent_t;
+
+
+// Executed instructions of one CPU in a single producer, single consumer ring. Without a file the ring only keeps
+// the newest TRACE_RING_SZ entries for trace_dump. With one open the writer thread stores every entry as raw
+// trace_ent_t records, and the emulation thread waits instead of overwriting what was not written yet.
+class TRACE {
+  public:
+    trace_ent_t          *ring = nullptr;
+    std::atomic<uint64_t> head{0};       // Entries recorded so far
+    std::atomic<uint64_t> tail{0};       // Entries in the file so far
+    uint64_t              tail_seen;     // Producer copy of tail, refreshed when the ring looks full
+    FILE                 *file = nullptr;
+    bool                  quit = false;
+
+    std::mutex              lock;
+    std::condition_variable work_cv;
+    std::thread             writer_thread;
+
+  public:
+    TRACE();
+    ~TRACE();
+
+    void trace_add(uint32_t pc, uint32_t op, uint32_t cpsr, uint32_t cycles)
+    {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        if (file && pos - tail_seen >= TRACE_RING_SZ)
+            trace_wait(pos);
+        trace_ent_t *ent = &ring[pos & TRACE_RING_MSK];
+        ent->pc          = pc;
+        ent->op          = op;
+        ent->cpsr        = cpsr;
+        ent->cycles      = cycles;
+        head.store(pos + 1, std::memory_order_release);
+        if (file && !((pos + 1) & (TRACE_CHUNK - 1)))
+            work_cv.notify_one();
+    }
+    void trace_wait(uint64_t pos);
+    void trace_dump(FILE *out, uint32_t cnt);
+    bool trace_open(const char *path);
+    void trace_close();
+    void writer();
+};
+
+#endif
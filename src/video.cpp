@@ -2,7 +2,6 @@
 #include "mem.h"
 #include "dma.h"
 #include "io.h"
-#include <SDL2/SDL.h>
 #include "sound.h"
 #include "video.h"
 